@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "tbb/global_control.h"
+
+#include "scene.h"
+#include "objects.h"
+#include "materials.h"
+#include "camera.h"
+#include "renderer.h"
+
+struct CliOptions
+{
+    uint32_t width = 1000;
+    uint32_t height = 700;
+    int samples = 100;
+    int threads = 0;
+    int tileSize = 32;
+    bool jitter = true;
+    bool packets = true;
+    bool wavefront = false;
+    bool nextEventEstimation = true;
+    bool denoise = false;
+    // Mask of 1 << AOV bits
+    uint32_t aovs = 0;
+    float exposure = 0.0f;
+    Tonemapper::Curve curve = Tonemapper::Curve::ACES;
+    int maxDepth = 10;
+    int rouletteDepth = 3;
+    float noiseThreshold = 0.0f;
+    std::string output = "render.png";
+    std::string checkpoint;
+    float checkpointInterval = 300.0f;
+    std::string resume;
+    std::string tileStats;
+    std::string mesh;
+    int instances = 0;
+};
+
+static void printUsage(const char *program)
+{
+    std::printf("Usage: %s [options]\n"
+                "  --width <px>       Image width (default 1000)\n"
+                "  --height <px>      Image height (default 700)\n"
+                "  --samples <n>      Samples per pixel (default 100)\n"
+                "  --threads <n>      Worker threads, 0 = all cores (default 0)\n"
+                "  --tile-size <px>   Scheduler bucket size (default 32)\n"
+                "  --jitter <0|1>     Jitter camera rays within the pixel (default 1)\n"
+                "  --packets <0|1>    Trace camera rays as 8x8 packets (default 1)\n"
+                "  --wavefront <0|1>  Use the wavefront integrator (default 0)\n"
+                "  --nee <0|1>        Sample lights with shadow rays (default 1)\n"
+                "  --max-depth <n>    Longest path in segments (default 10)\n"
+                "  --rr-depth <n>     Russian roulette from this depth on (default 3)\n"
+                "  --noise <e>        Stop sampling tiles below this error, 0 = off (default 0)\n"
+                "  --denoise <0|1>    Filter the final image with the a-trous denoiser (default 0)\n"
+                "  --aovs <list>      Also save these AOVs, comma separated from albedo, normal,\n"
+                "                     depth, material, object, samples\n"
+                "  --exposure <stops> Scale the image before tonemapping (default 0)\n"
+                "  --tonemap <curve>  linear or aces (default aces)\n"
+                "  --output <file>    Output path, .png or linear float .exr / .pfm (default render.png)\n"
+                "  --checkpoint <rzc> Save progress here periodically and when done\n"
+                "  --checkpoint-interval <s>\n"
+                "                     Seconds between checkpoints (default 300)\n"
+                "  --resume <rzc>     Continue from a checkpoint of the same scene and settings\n"
+                "  --tile-stats <csv> Write per-tile times of the last sample\n"
+                "  --obj <file>       Add a Wavefront OBJ mesh to the scene\n"
+                "  --instances <n>    Place the OBJ mesh n times on a grid instead (default 0)\n",
+                program);
+}
+
+static bool parseAOVs(const char *value, uint32_t &mask)
+{
+    std::string list = value;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = std::min(list.find(',', start), list.size());
+        std::string name = list.substr(start, end - start);
+        int aov = (int)AOV::ALBEDO;
+        while (aov < (int)AOV::COUNT && name != Renderer::getAOVName((AOV)aov))
+            aov++;
+        if (aov == (int)AOV::COUNT)
+        {
+            std::fprintf(stderr, "Unknown AOV %s\n", name.c_str());
+            return false;
+        }
+
+        mask |= 1u << aov;
+        start = end + 1;
+    }
+    return true;
+}
+
+// The whole value must be a number within [minimum, maximum]
+template <typename T>
+static bool parseInteger(const char *arg, const char *value, long minimum, long maximum, T &output)
+{
+    char *end;
+    errno = 0;
+    long parsed = std::strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || parsed < minimum || parsed > maximum)
+    {
+        std::fprintf(stderr, "%s expects a whole number from %ld to %ld, got %s\n", arg, minimum, maximum, value);
+        return false;
+    }
+    output = (T)parsed;
+    return true;
+}
+
+static bool parseFloat(const char *arg, const char *value, float minimum, float maximum, float &output)
+{
+    char *end;
+    errno = 0;
+    float parsed = std::strtof(value, &end);
+    if (end == value || *end != '\0' || errno == ERANGE || !(parsed >= minimum && parsed <= maximum))
+    {
+        std::fprintf(stderr, "%s expects a number from %g to %g, got %s\n", arg, minimum, maximum, value);
+        return false;
+    }
+    output = parsed;
+    return true;
+}
+
+static bool parseArgs(int argc, char **argv, CliOptions &options)
+{
+    // Beyond this the buffers alone take tens of gigabytes
+    const long maxImageSize = 16384;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (!std::strcmp(arg, "--help") || !std::strcmp(arg, "-h"))
+            return false;
+
+        if (i + 1 >= argc)
+        {
+            std::fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        const char *value = argv[++i];
+        bool valid = true;
+        if (!std::strcmp(arg, "--width"))
+            valid = parseInteger(arg, value, 1, maxImageSize, options.width);
+        else if (!std::strcmp(arg, "--height"))
+            valid = parseInteger(arg, value, 1, maxImageSize, options.height);
+        else if (!std::strcmp(arg, "--samples"))
+            valid = parseInteger(arg, value, 1, 1000000, options.samples);
+        else if (!std::strcmp(arg, "--threads"))
+            valid = parseInteger(arg, value, 0, 1024, options.threads);
+        else if (!std::strcmp(arg, "--tile-size"))
+            valid = parseInteger(arg, value, 1, maxImageSize, options.tileSize);
+        else if (!std::strcmp(arg, "--jitter"))
+            valid = parseInteger(arg, value, 0, 1, options.jitter);
+        else if (!std::strcmp(arg, "--packets"))
+            valid = parseInteger(arg, value, 0, 1, options.packets);
+        else if (!std::strcmp(arg, "--wavefront"))
+            valid = parseInteger(arg, value, 0, 1, options.wavefront);
+        else if (!std::strcmp(arg, "--nee"))
+            valid = parseInteger(arg, value, 0, 1, options.nextEventEstimation);
+        else if (!std::strcmp(arg, "--max-depth"))
+            valid = parseInteger(arg, value, 1, 256, options.maxDepth);
+        else if (!std::strcmp(arg, "--rr-depth"))
+            valid = parseInteger(arg, value, 1, 256, options.rouletteDepth);
+        else if (!std::strcmp(arg, "--noise"))
+            valid = parseFloat(arg, value, 0.0f, 1.0f, options.noiseThreshold);
+        else if (!std::strcmp(arg, "--denoise"))
+            valid = parseInteger(arg, value, 0, 1, options.denoise);
+        else if (!std::strcmp(arg, "--aovs"))
+            valid = parseAOVs(value, options.aovs);
+        else if (!std::strcmp(arg, "--exposure"))
+            valid = parseFloat(arg, value, -32.0f, 32.0f, options.exposure);
+        else if (!std::strcmp(arg, "--tonemap"))
+        {
+            if (!std::strcmp(value, "linear"))
+                options.curve = Tonemapper::Curve::LINEAR;
+            else if (!std::strcmp(value, "aces"))
+                options.curve = Tonemapper::Curve::ACES;
+            else
+            {
+                std::fprintf(stderr, "Unknown tone curve %s\n", value);
+                valid = false;
+            }
+        }
+        else if (!std::strcmp(arg, "--output"))
+            options.output = value;
+        else if (!std::strcmp(arg, "--checkpoint"))
+            options.checkpoint = value;
+        else if (!std::strcmp(arg, "--checkpoint-interval"))
+            valid = parseFloat(arg, value, 0.0f, 1e6f, options.checkpointInterval);
+        else if (!std::strcmp(arg, "--resume"))
+            options.resume = value;
+        else if (!std::strcmp(arg, "--tile-stats"))
+            options.tileStats = value;
+        else if (!std::strcmp(arg, "--obj"))
+            options.mesh = value;
+        else if (!std::strcmp(arg, "--instances"))
+            valid = parseInteger(arg, value, 0, 1000000, options.instances);
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", arg);
+            valid = false;
+        }
+
+        if (!valid)
+            return false;
+    }
+
+    return true;
+}
+
+static bool writeTileStats(const std::string &filePath, const Renderer &renderer)
+{
+    FILE *file = std::fopen(filePath.c_str(), "w");
+    if (!file)
+        return false;
+
+    std::fprintf(file, "x,y,width,height,ms\n");
+    for (const auto &tile : renderer.getTiles())
+        std::fprintf(file, "%u,%u,%u,%u,%.4f\n", tile.x, tile.y, tile.width, tile.height, tile.renderTime);
+
+    std::fclose(file);
+    return true;
+}
+
+static void printBuildStats(const BVH::BuildStats &stats)
+{
+    std::printf("BVH: %u nodes (%u wide), %u leaves, depth %u, SAH cost %.3f, built in %.3fms\n",
+                stats.nodeCount, stats.wideNodeCount, stats.leafCount, stats.maxDepth, stats.sahCost, stats.buildTime);
+
+    std::printf("Leaf sizes:");
+    for (size_t i = 1; i < stats.leafSizeHistogram.size(); i++)
+        std::printf(" %zu:%u", i, stats.leafSizeHistogram[i]);
+    std::printf("\n");
+}
+
+// Lays count instances of the mesh out on a grid over a 2x2 square below the
+// default scene, each scaled to fit its cell
+static void addInstanceGrid(Scene &scene, const std::shared_ptr<TriangleMesh> &mesh, int count)
+{
+    AABB bounds;
+    mesh->boundingBox(bounds);
+    glm::vec3 extent = bounds.getMax() - bounds.getMin();
+    glm::vec3 center = 0.5f * (bounds.getMin() + bounds.getMax());
+
+    int side = (int)std::ceil(std::sqrt((float)count));
+    float cell = 2.0f / side;
+    float scale = 0.8f * cell / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+
+    for (int i = 0; i < count; i++)
+    {
+        glm::vec3 cellCenter(-1.0f + cell * (i % side + 0.5f), -0.6f + 0.5f * scale * extent.y, -1.0f + cell * (i / side + 0.5f));
+        scene.add(std::make_shared<Instance>("Instance " + std::to_string(i), mesh, cellCenter - scale * center,
+                                             glm::vec3(0.0f), glm::vec3(scale)));
+    }
+    std::printf("Placed %d instances sharing one mesh BVH\n", count);
+}
+
+int main(int argc, char **argv)
+{
+    CliOptions options;
+    if (!parseArgs(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // The tile scheduler has its own pool, this caps TBB's for the BVH builds
+    std::unique_ptr<tbb::global_control> threadLimit;
+    if (options.threads > 0)
+        threadLimit = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, options.threads);
+
+    Scene scene("Main Scene");
+    scene.loadDefault();
+
+    if (!options.mesh.empty())
+    {
+        auto mesh = TriangleMesh::LoadOBJ("Mesh", options.mesh, scene.addMaterial(std::make_shared<Lambertian>(glm::vec3(0.8f))));
+        if (!mesh)
+            return 1;
+
+        std::printf("Loaded %s: %u triangles, %s triangle kernel\n", options.mesh.c_str(), mesh->getTriangleCount(), TriangleBlock::getKernelName());
+        printBuildStats(mesh->getBuildStats());
+        if (options.instances > 0)
+            addInstanceGrid(scene, mesh, options.instances);
+        else
+            scene.add(mesh);
+    }
+
+    scene.build();
+    printBuildStats(scene.getBuildStats());
+    std::printf("Emitters: %u primitives\n", scene.getEmitters().getPrimitiveCount());
+
+    Camera camera(45.0f, 0.1f, 100.0f);
+    camera.onResize(options.width, options.height);
+
+    Renderer renderer;
+    // frameIndex stops one short of maxFrames
+    renderer.getSettings().maxFrames = options.samples + 1;
+    renderer.getSettings().workerCount = options.threads;
+    renderer.getSettings().jitter = options.jitter;
+    renderer.getSettings().primaryPackets = options.packets;
+    renderer.getSettings().wavefront = options.wavefront;
+    renderer.getSettings().nextEventEstimation = options.nextEventEstimation;
+    renderer.getSettings().maxDepth = options.maxDepth;
+    renderer.getSettings().rouletteDepth = options.rouletteDepth;
+    renderer.getSettings().noiseThreshold = options.noiseThreshold;
+    renderer.getSettings().denoise = options.denoise;
+    // Nobody watches the intermediate frames, saveImage denoises once
+    renderer.getSettings().denoiseInterval = 0;
+    renderer.getSettings().aovs = options.aovs;
+    renderer.getTonemapperSettings().exposure = options.exposure;
+    renderer.getTonemapperSettings().curve = options.curve;
+    renderer.getSettings().checkpointPath = options.checkpoint;
+    renderer.getSettings().checkpointInterval = options.checkpointInterval;
+    // Every frame is a final sample here
+    renderer.getSettings().dynamicResolution = false;
+    renderer.getSettings().tileSize = options.tileSize;
+    renderer.onResize(options.width, options.height);
+
+    // currentSample is the frame about to be traced
+    int firstSample = 0;
+    if (!options.resume.empty())
+    {
+        if (!renderer.loadCheckpoint(options.resume, scene, camera))
+            return 1;
+        firstSample = std::min(renderer.getStatus().currentSample - 1, options.samples);
+        std::printf("Resumed %s with %d samples\n", options.resume.c_str(), firstSample);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = firstSample; i < options.samples; i++)
+    {
+        renderer.render(scene, camera);
+        std::fprintf(stderr, "\rSample %d / %d", i + 1, options.samples);
+    }
+    std::fprintf(stderr, "\n");
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double pixelSamples = (double)options.width * options.height * (options.samples - firstSample);
+    std::printf("Rendered %ux%u @ %d spp in %.3fs (%.3f Msamples/s)\n",
+                options.width, options.height, options.samples - firstSample, seconds, pixelSamples / std::max(seconds, 1e-9) * 1e-6);
+
+    if (!options.checkpoint.empty())
+    {
+        if (!renderer.saveCheckpoint(options.checkpoint, scene, camera))
+        {
+            std::fprintf(stderr, "Failed to write %s\n", options.checkpoint.c_str());
+            return 1;
+        }
+        std::printf("Saved checkpoint %s\n", options.checkpoint.c_str());
+    }
+
+    auto status = renderer.getStatus();
+    std::printf("Tiles: %d, last sample min/avg/max %.3f/%.3f/%.3fms, %d steals\n",
+                status.tiles.tileCount, status.tiles.minTileTime, status.tiles.averageTileTime, status.tiles.maxTileTime, status.tiles.steals);
+    if (options.noiseThreshold > 0.0f && !options.wavefront)
+        std::printf("Adaptive sampling: %.1f%% of pixels still active\n", 100.0f * status.activeFraction);
+    if (options.wavefront)
+        std::printf("Wavefront: %u segments and %u shadow rays over %u bounces, extend/sort/shade/shadow %.2f/%.2f/%.2f/%.2fms\n",
+                    status.wavefront.pathSegments, status.wavefront.shadowRays, status.wavefront.bounces,
+                    status.wavefront.extendTime, status.wavefront.sortTime, status.wavefront.shadeTime, status.wavefront.shadowTime);
+
+    if (!options.tileStats.empty() && !writeTileStats(options.tileStats, renderer))
+        std::fprintf(stderr, "Failed to write %s\n", options.tileStats.c_str());
+
+    if (!renderer.saveImage(options.output))
+    {
+        std::fprintf(stderr, "Failed to write %s\n", options.output.c_str());
+        return 1;
+    }
+
+    std::printf("Saved %s\n", options.output.c_str());
+    if (options.denoise)
+        std::printf("Denoiser: %.2fms\n", renderer.getStatus().denoiser.denoiseTime);
+
+    if (options.aovs && !renderer.saveAOVs(options.output))
+    {
+        std::fprintf(stderr, "Failed to write AOVs next to %s\n", options.output.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAYZ_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+#include "ray.h"
+#include "rayPacket.h"
+#include "boundingBox.h"
+
+// 32 byte node, children are stored next to each other so only the first
+// index is kept. Leaves reference a run of primitiveIndices instead.
+struct BVHNode
+{
+    glm::vec3 boundsMin;
+    uint32_t leftFirst;
+    glm::vec3 boundsMax;
+    uint32_t count;
+
+    bool isLeaf() const
+    {
+        return count > 0;
+    }
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode should fit half a cache line");
+
+// Binary nodes collapsed four to one for single ray traversal. Child bounds
+// are stored as bounds[min/max][axis][child] so one SSE slab test covers all
+// children. Leaf children keep the index of their binary node.
+struct alignas(16) BVH4Node
+{
+    static constexpr uint32_t leafFlag = 0x80000000u;
+
+    float bounds[2][3][4];
+    uint32_t children[4];
+    uint32_t childCount;
+};
+
+// Per ray constants of a traversal, computed once instead of per box
+struct RayTraversal
+{
+    glm::vec3 invDirection;
+    // origin * invDirection, the slab distance becomes one multiply-subtract
+    glm::vec3 originScaled;
+    // 1 where the direction is negative, picks the near plane per axis
+    uint32_t sign[3];
+
+    RayTraversal(const Ray &ray)
+        : invDirection(1.0f / ray.direction), originScaled(ray.origin * invDirection)
+    {
+        for (int a = 0; a < 3; a++)
+            sign[a] = invDirection[a] < 0.0f;
+    }
+};
+
+// Flattened bounding volume hierarchy over an external primitive table. The
+// owner keeps the primitives and resolves the indices handed to it during
+// traversal, which lets scenes and meshes share the same structure.
+class BVH
+{
+public:
+    struct BuildStats
+    {
+        float buildTime = 0.0f;
+        // Expected traversal cost relative to the root, lower is better
+        float sahCost = 0.0f;
+        uint32_t nodeCount = 0;
+        uint32_t leafCount = 0;
+        uint32_t maxDepth = 0;
+        uint32_t wideNodeCount = 0;
+        // Refits applied since the last build and the time of the latest
+        uint32_t refitCount = 0;
+        float refitTime = 0.0f;
+        // Number of leaves holding i primitives
+        std::vector<uint32_t> leafSizeHistogram;
+    };
+
+    std::vector<BVHNode> nodes;
+    std::vector<BVH4Node> wideNodes;
+    std::vector<uint32_t> primitiveIndices;
+
+    // Binned SAH build, subtrees above parallelThreshold primitives are
+    // built as separate TBB tasks. Owners that test leaves leafBlockSize
+    // primitives at a time pass it so the SAH charges whole blocks.
+    void build(const std::vector<AABB> &primitiveBounds, uint32_t maxLeafSize = 4, uint32_t leafBlockSize = 1);
+    void clear();
+    bool empty() const;
+
+    // Recomputes the bounds of the changed primitives' leaves and of their
+    // ancestors only, keeping the tree topology. Returns false once the SAH
+    // cost has grown past rebuildThreshold times the built one, the owner
+    // should build() again then.
+    bool refit(const std::vector<AABB> &primitiveBounds, const std::vector<uint32_t> &changedPrimitives);
+
+    const BuildStats &getBuildStats() const;
+
+    // intersect(primitive, tMax) tests one primitive, shrinking tMax and
+    // returning true on a closer hit. Near children are visited first.
+    // Dropping tMax below tMin ends the walk, for any hit queries.
+    template <typename Intersect>
+    bool traverse(const Ray &ray, float tMin, float &tMax, Intersect &&intersect) const
+    {
+        return traverseLeaves(ray, tMin, tMax, [this, &intersect](uint32_t nodeIndex, float &tMaxRef)
+                              {
+                                  const BVHNode &leaf = nodes[nodeIndex];
+                                  bool hitLeaf = false;
+                                  for (uint32_t i = 0; i < leaf.count; i++)
+                                      if (intersect(primitiveIndices[leaf.leftFirst + i], tMaxRef))
+                                          hitLeaf = true;
+                                  return hitLeaf; });
+    }
+
+    // Same walk, but intersectLeaf(nodeIndex, tMax) handles a whole leaf so
+    // owners can keep their own per-leaf primitive layout. Runs over the
+    // collapsed 4-wide nodes, nodeIndex still refers to the binary leaf.
+    template <typename IntersectLeaf>
+    bool traverseLeaves(const Ray &ray, float tMin, float &tMax, IntersectLeaf &&intersectLeaf) const
+    {
+        if (nodes.empty())
+            return false;
+
+        const RayTraversal traversal(ray);
+        bool hitAnything = false;
+
+        struct Entry
+        {
+            uint32_t node;
+            float distance;
+        };
+        Entry stack[3 * maxDepth + 4];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = {rootEntry(), tMin};
+
+        while (stackSize > 0)
+        {
+            Entry entry = stack[--stackSize];
+            if (entry.distance > tMax)
+                continue;
+
+            if (entry.node & BVH4Node::leafFlag)
+            {
+                if (intersectLeaf(entry.node & ~BVH4Node::leafFlag, tMax))
+                    hitAnything = true;
+                continue;
+            }
+
+            const BVH4Node &node = wideNodes[entry.node];
+            float distances[4];
+            uint32_t mask = intersectChildren(node, traversal, tMin, tMax, distances);
+
+            // Push far to near so the closest child is popped first
+            Entry hits[4];
+            uint32_t hitCount = 0;
+            for (uint32_t i = 0; i < node.childCount; i++)
+            {
+                if (!(mask & (1u << i)))
+                    continue;
+
+                Entry child = {node.children[i], distances[i]};
+                uint32_t j = hitCount++;
+                for (; j > 0 && hits[j - 1].distance < child.distance; j--)
+                    hits[j] = hits[j - 1];
+                hits[j] = child;
+            }
+            for (uint32_t i = 0; i < hitCount; i++)
+                stack[stackSize++] = hits[i];
+        }
+
+        return hitAnything;
+    }
+
+    // Packet walk for rays sharing an origin. A node is culled for the whole
+    // packet by the interval test, otherwise rays are skipped up to the first
+    // one entering it and only that ray orders the children.
+    // intersectLeaf(nodeIndex, firstActive) handles rays from firstActive on.
+    template <typename IntersectLeaf>
+    void traversePacket(RayPacket &packet, float tMin, IntersectLeaf &&intersectLeaf) const
+    {
+        if (nodes.empty() || packet.count == 0)
+            return;
+
+        struct Entry
+        {
+            uint32_t node, firstActive;
+        };
+        Entry stack[64];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = {0, 0};
+
+        float packetTMax = packetFarthest(packet);
+        while (stackSize > 0)
+        {
+            Entry entry = stack[--stackSize];
+            const BVHNode &node = nodes[entry.node];
+            if (packet.coherent && !intersectPacketBounds(node, packet, tMin, packetTMax))
+                continue;
+
+            uint32_t first = entry.firstActive;
+            while (first < packet.count &&
+                   intersectBox(node, packet.origin, packet.invDirections[first], tMin, packet.tMax[first]) == std::numeric_limits<float>::infinity())
+                first++;
+            if (first == packet.count)
+                continue;
+
+            if (node.isLeaf())
+            {
+                intersectLeaf(entry.node, first);
+                packetTMax = packetFarthest(packet);
+                continue;
+            }
+
+            uint32_t nearIndex = node.leftFirst;
+            uint32_t farIndex = node.leftFirst + 1;
+            const glm::vec3 &invDirection = packet.invDirections[first];
+            if (intersectBox(nodes[farIndex], packet.origin, invDirection, tMin, packet.tMax[first]) <
+                intersectBox(nodes[nearIndex], packet.origin, invDirection, tMin, packet.tMax[first]))
+                std::swap(nearIndex, farIndex);
+
+            stack[stackSize++] = {farIndex, first};
+            stack[stackSize++] = {nearIndex, first};
+        }
+    }
+
+    // Slab test of all children at once, returns a bit per child hit within
+    // [tMin, tMax] and writes their entry distances
+    static uint32_t intersectChildren(const BVH4Node &node, const RayTraversal &traversal, float tMin, float tMax, float distances[4])
+    {
+#ifdef RAYZ_BVH_SSE
+        __m128 entry = _mm_set1_ps(tMin);
+        __m128 exit = _mm_set1_ps(tMax);
+        for (int a = 0; a < 3; a++)
+        {
+            const __m128 invDirection = _mm_set1_ps(traversal.invDirection[a]);
+            const __m128 originScaled = _mm_set1_ps(traversal.originScaled[a]);
+            __m128 nearPlane = _mm_load_ps(node.bounds[traversal.sign[a]][a]);
+            __m128 farPlane = _mm_load_ps(node.bounds[1 - traversal.sign[a]][a]);
+
+            // NaN slabs (0 * inf) leave the running interval untouched
+            entry = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(nearPlane, invDirection), originScaled), entry);
+            exit = _mm_min_ps(_mm_sub_ps(_mm_mul_ps(farPlane, invDirection), originScaled), exit);
+        }
+        _mm_storeu_ps(distances, entry);
+        uint32_t mask = _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            float entry = tMin, exit = tMax;
+            for (int a = 0; a < 3; a++)
+            {
+                float nearDistance = node.bounds[traversal.sign[a]][a][i] * traversal.invDirection[a] - traversal.originScaled[a];
+                float farDistance = node.bounds[1 - traversal.sign[a]][a][i] * traversal.invDirection[a] - traversal.originScaled[a];
+                entry = nearDistance > entry ? nearDistance : entry;
+                exit = farDistance < exit ? farDistance : exit;
+            }
+            distances[i] = entry;
+            if (entry <= exit)
+                mask |= 1u << i;
+        }
+#endif
+        return mask & ((1u << node.childCount) - 1);
+    }
+
+    // Entry distance of the ray into the node, infinity on a miss
+    static float intersectBox(const BVHNode &node, const glm::vec3 &origin, const glm::vec3 &invDirection, float tMin, float tMax)
+    {
+        glm::vec3 t0 = (node.boundsMin - origin) * invDirection;
+        glm::vec3 t1 = (node.boundsMax - origin) * invDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        float entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tMin));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+
+        return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+    }
+
+    // Conservative slab test of a coherent packet against the node using the
+    // range of its inverse directions, false only if every ray misses
+    static bool intersectPacketBounds(const BVHNode &node, const RayPacket &packet, float tMin, float tMax)
+    {
+        float entry = tMin, exit = tMax;
+        for (int a = 0; a < 3; a++)
+        {
+            bool positive = packet.invDirectionMin[a] > 0.0f;
+            float nearPlane = (positive ? node.boundsMin[a] : node.boundsMax[a]) - packet.origin[a];
+            float farPlane = (positive ? node.boundsMax[a] : node.boundsMin[a]) - packet.origin[a];
+
+            entry = glm::max(entry, glm::min(nearPlane * packet.invDirectionMin[a], nearPlane * packet.invDirectionMax[a]));
+            exit = glm::min(exit, glm::max(farPlane * packet.invDirectionMin[a], farPlane * packet.invDirectionMax[a]));
+        }
+        return entry <= exit;
+    }
+
+private:
+    static constexpr uint32_t binCount = 16;
+    static constexpr uint32_t maxDepth = 48;
+    static constexpr uint32_t parallelThreshold = 4096;
+    static constexpr float traversalCost = 1.0f;
+    static constexpr float intersectionCost = 1.0f;
+    static constexpr float rebuildThreshold = 1.5f;
+    static constexpr uint32_t noSlot = ~0u;
+
+    struct BuildContext;
+
+    BuildStats stats;
+    uint32_t leafBlockSize = 1;
+
+    // Refit bookkeeping: parent of every node, leaf of every primitive and
+    // the wide node slot (wideIndex * 4 + child) holding each node's bounds
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> primitiveLeaves;
+    std::vector<uint32_t> wideSlots;
+    // Sum of cost * area over all nodes, sahCost is this over the root area
+    float weightedArea = 0.0f;
+    float builtSahCost = 0.0f;
+
+    void subdivide(BuildContext &context, uint32_t nodeIndex, uint32_t depth);
+    bool findSplit(BuildContext &context, const BVHNode &node, int &axis, float &splitPosition) const;
+    void updateBounds(BuildContext &context, uint32_t nodeIndex);
+    void computeStats();
+    void collapse();
+    uint32_t collapseNode(uint32_t nodeIndex);
+    void linkNodes();
+    bool setNodeBounds(uint32_t nodeIndex, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+    // Stack entry of the traversal root, a lone leaf has no wide node
+    uint32_t rootEntry() const
+    {
+        return nodes[0].isLeaf() ? BVH4Node::leafFlag : 0;
+    }
+
+    float leafCost(uint32_t count) const;
+
+    static float packetFarthest(const RayPacket &packet)
+    {
+        float farthest = 0.0f;
+        for (uint32_t i = 0; i < packet.count; i++)
+            farthest = glm::max(farthest, packet.tMax[i]);
+        return farthest;
+    }
+    static float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+};
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <vector>
+#include <cstdint>
 
 #include "glm/glm.hpp"
 
@@ -16,8 +16,9 @@ private:
     glm::vec3 position;
     glm::vec3 forwardDirection;
 
-    // Cached ray directions
-    std::vector<glm::vec3> rayDirections;
+    // Unnormalized world space direction through pixel coordinates (x, y) is
+    // rayBase + x * rayStepX + y * rayStepY, so rays are made on the fly
+    glm::vec3 rayBase, rayStepX, rayStepY;
 
     glm::vec2 lastMousePosition;
 
@@ -26,7 +27,9 @@ private:
 public:
     Camera(float verticalFOV, float nearClip, float farClip);
 
+#ifndef RAYZ_HEADLESS
     bool onUpdate(float ts);
+#endif
     void onResize(int width, int height);
 
     const glm::mat4 &getProjection() const;
@@ -36,12 +39,16 @@ public:
 
     const glm::vec3 &getPosition() const;
     const glm::vec3 &getDirection() const;
+    float getVerticalFOV() const;
     float getRotationSpeed();
 
-    const std::vector<glm::vec3> &getRayDirections() const;
+    // Normalized directions of count pixels starting at (x, y) along the row.
+    // jitter holds one sub-pixel offset in [0, 1) per pixel, nullptr aims at
+    // the pixel corners. Four rays at a time with SSE.
+    void generateRays(uint32_t x, uint32_t y, uint32_t count, const glm::vec2 *jitter, glm::vec3 *directions) const;
 
 private:
     void recalculateProjection();
     void recalculateView();
-    void recalculateRayDirections();
+    void recalculateRayBasis();
 };
\ No newline at end of file
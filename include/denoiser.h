@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "materials/material.h"
+#include "tileScheduler.h"
+
+// First surface a path sees, summed over a pixel's samples like its radiance.
+// Mirrors and glass are looked through, so reflections keep their own edges.
+struct PixelFeatures
+{
+    glm::vec3 albedo = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    // Distance along the path up to the recorded surface
+    float depth = 0.0f;
+    // What the camera ray itself hit, null for misses. Identifies a pixel
+    // instead of being summed, the pixel's first sample is kept.
+    const Hittable *object = nullptr;
+    uint32_t materialId = 0;
+
+    // Hit reached through delta scattering only, throughput included
+    void addHit(const Ray &ray, const HitPayload &payload, const glm::vec3 &surfaceAlbedo)
+    {
+        if (depth == 0.0f)
+        {
+            object = payload.object;
+            materialId = payload.materialId;
+        }
+        depth += payload.hitDistance * glm::length(ray.direction);
+        normal = payload.worldNormal;
+        albedo = surfaceAlbedo;
+    }
+
+    void addMiss(const glm::vec3 &throughput)
+    {
+        normal = glm::vec3(0.0f);
+        albedo = throughput;
+    }
+};
+
+// Edge-avoiding a-trous wavelet filter in the manner of SVGF. Radiance is
+// divided by albedo so textures survive, then a 5x5 B3 spline kernel is
+// applied with doubling step sizes. Taps are weighted down across normal
+// and depth edges and where luminance differs by more than the pixel's
+// estimated noise.
+class Denoiser
+{
+public:
+    struct Settings
+    {
+        // Passes of the kernel, the footprint doubles with each
+        int iterations = 5;
+        // Luminance differences are measured in standard deviations
+        float colorSigma = 4.0f;
+        // Depth differences relative to the local depth gradient
+        float depthSigma = 1.0f;
+    };
+
+    struct Stats
+    {
+        float denoiseTime = 0.0f;
+    };
+
+    // Filters the per-pixel means of the radiance sums. squaredLuminance
+    // feeds the noise estimate.
+    void denoise(const glm::vec3 *radianceSums, const uint32_t *sampleCounts, const float *squaredLuminance, const PixelFeatures *features,
+                 uint32_t width, uint32_t height, TileScheduler &scheduler);
+
+    // Filtered radiance of the last denoise, width * height pixels
+    const glm::vec3 *getOutput() const;
+
+    Settings &getSettings();
+    const Stats &getStats() const;
+
+private:
+    Settings settings;
+    Stats stats;
+    uint32_t width = 0, height = 0;
+
+    // Demodulated radiance with the variance of its luminance in w, ping
+    // ponged between passes. guides holds normal and depth, gradients the
+    // screen space depth slope. Four floats per pixel keep taps aligned.
+    std::vector<glm::vec4> irradiance, filtered;
+    std::vector<glm::vec4> guides;
+    std::vector<glm::vec3> albedos;
+    std::vector<float> depthGradients;
+    std::vector<glm::vec3> output;
+
+    void prepare(const glm::vec3 *radianceSums, const uint32_t *sampleCounts, const float *squaredLuminance, const PixelFeatures *features,
+                 TileScheduler &scheduler);
+    void filterPass(int step, TileScheduler &scheduler);
+    void filterRow(uint32_t y, int step);
+    float smoothedVariance(uint32_t x, uint32_t y) const;
+};
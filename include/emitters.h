@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "hittable.h"
+#include "sampler.h"
+
+// Emissive primitives of a scene for next event estimation. One is picked
+// with probability proportional to its area and a point chosen uniformly on
+// it, so every point of every light has the same density 1 / total area.
+class EmitterList
+{
+public:
+    struct Sample
+    {
+        glm::vec3 position;
+        // Outward geometric normal, lights emit on this side only
+        glm::vec3 normal;
+        glm::vec2 uv;
+        uint32_t materialId;
+    };
+
+    void clear();
+    // Adds every sampleable primitive of the object
+    void add(const Hittable *object, uint32_t materialId);
+
+    bool empty() const;
+    uint32_t getPrimitiveCount() const;
+    bool contains(const Hittable *object) const;
+
+    void sample(Sampler &sampler, Sample &sample) const;
+    // Area density of sample() anywhere on a listed emitter
+    float getAreaPdf() const;
+
+private:
+    struct Emitter
+    {
+        const Hittable *object;
+        uint32_t primitiveId;
+        uint32_t materialId;
+    };
+
+    std::vector<Emitter> emitters;
+    // Running sum of the areas, for the binary search in sample()
+    std::vector<float> cumulativeAreas;
+    std::vector<const Hittable *> objects;
+    float totalArea = 0.0f;
+};
@@ -7,17 +7,73 @@
 #include "glm/glm.hpp"
 
 #include "ray.h"
+#include "rayPacket.h"
 #include "boundingBox.h"
 #include "materials/material.h"
 
+class Hittable;
+
+// Minimal record kept while searching for the closest hit. Everything else
+// about the surface is derived once, for the final hit only.
+struct Intersection
+{
+    float t;
+    // Primitive inside the object, e.g. the triangle of a mesh
+    uint32_t primitiveId;
+    // Barycentrics of v1 and v2 for triangles
+    float u, v;
+    const Hittable *object;
+    // Object hit inside an Instance, only meaningful when object is one
+    const Hittable *instanceObject;
+};
+
 class Hittable
 {
 public:
     const std::string name;
     Hittable(const std::string &name);
 
-    virtual bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const = 0;
+    // Closest hit in [tMin, tMax], fills only the Intersection record
+    virtual bool intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const = 0;
+    // Position, normal, UVs and material of an intersection found by this object
+    virtual void computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const = 0;
+
+    // intersect followed by computeSurfaceInteraction on the closest hit
+    bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const;
+
+    // Any hit in [tMin, tMax], for shadow rays. The default searches for the
+    // closest one, containers override it to stop at the first.
+    virtual bool occluded(const Ray &ray, float tMin, float tMax) const;
+
+    // Intersects the rays of the packet from firstActive on up to their tMax,
+    // writing intersections[i] and shrinking tMax[i] on closer hits. Returns
+    // a mask of the rays that were hit. The default tests the rays one by one.
+    virtual uint64_t intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const;
+    // intersectPacket followed by the surface interaction of every hit ray
+    uint64_t hitPacket(RayPacket &packet, float tMin, HitPayload *payloads) const;
+
     virtual bool boundingBox(AABB &outputox) const = 0;
+    // Scene material table index, false for objects without one
+    virtual bool material(uint32_t &outputId) const
+    {
+        return false;
+    }
+
+    // Area sampling for emitters: primitives that can be sampled, their
+    // area, and a uniform point on one from u in [0, 1)^2 with its outward
+    // geometric normal and UVs. Objects that cannot be sampled have none.
+    virtual uint32_t getSampleablePrimitiveCount() const
+    {
+        return 0;
+    }
+    virtual float getPrimitiveArea(uint32_t primitiveId) const
+    {
+        return 0.0f;
+    }
+    virtual void samplePrimitive(uint32_t primitiveId, const glm::vec2 &u, glm::vec3 &position, glm::vec3 &normal, glm::vec2 &uv) const
+    {
+    }
+
     virtual bool renderUI()
     {
         return false;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <functional>
+
+// Window-free image output, shared by the viewer and rayz_cli
+class ImageWriter
+{
+public:
+    // Fills row y with width * channels floats, channels interleaved. Rows
+    // are numbered bottom-up like the display buffer.
+    using FloatRowSource = std::function<void(uint32_t y, float *row)>;
+
+    static bool writePNG(const std::string &filePath, uint32_t width, uint32_t height, const uint32_t *data);
+
+    // Linear 32 bit float images with 1 or 3 channels, pulled one row at a
+    // time so no second copy of the image is made
+    static bool writePFM(const std::string &filePath, uint32_t width, uint32_t height, uint32_t channels, const FloatRowSource &rows);
+    // Scanline OpenEXR with RLE compression, one line per chunk
+    static bool writeEXR(const std::string &filePath, uint32_t width, uint32_t height, uint32_t channels, const FloatRowSource &rows);
+};
@@ -6,8 +6,12 @@ class Dieletric : public Material
 public:
     Dieletric(const glm::vec3 &albedo, float index_of_refraction);
     Dieletric(const std::shared_ptr<Texture> &texture, float index_of_refraction);
-    virtual bool scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const override;
+    virtual bool sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const override;
+    virtual glm::vec3 albedo(const HitPayload &payload) const override;
+    virtual MaterialType getType() const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
 private:
     static glm::vec3 refract(const glm::vec3 &uv, const glm::vec3 &n, float etai_over_etat);
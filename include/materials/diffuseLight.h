@@ -9,7 +9,12 @@ public:
     DiffuseLight(glm::vec3 albedo);
     DiffuseLight(const std::shared_ptr<Texture> &texture);
 
-    virtual bool scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const override;
+    virtual bool isEmissive() const override;
+    virtual bool sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const override;
+    virtual glm::vec3 albedo(const HitPayload &payload) const override;
+    virtual MaterialType getType() const override;
     virtual glm::vec3 emitted(const Ray &ray, const HitPayload &payload, double u, double v, const glm::vec3 &p) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 };
\ No newline at end of file
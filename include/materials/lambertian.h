@@ -6,8 +6,14 @@ class Lambertian : public Material
 public:
     Lambertian(const glm::vec3 &albedo);
     Lambertian(const std::shared_ptr<Texture> &texture);
-    virtual bool scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const override;
+    virtual bool sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const override;
+    virtual glm::vec3 eval(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const override;
+    virtual float pdf(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const override;
+    virtual glm::vec3 albedo(const HitPayload &payload) const override;
+    virtual MaterialType getType() const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
 public:
     std::shared_ptr<Texture> texture;
@@ -4,23 +4,53 @@
 
 #include "glm/glm.hpp"
 #include "ray.h"
+#include "sampler.h"
 
 #include "textures.h"
 
 class Material;
+class Hittable;
 
 struct HitPayload
 {
     glm::vec3 worldPosition;
     glm::vec3 worldNormal;
-    std::shared_ptr<Material> mat;
+    // Of the surface itself, before normal interpolation, on the same side
+    // as worldNormal
+    glm::vec3 geometricNormal;
+    // Index into the owning scene's material table
+    uint32_t materialId;
     float hitDistance;
     float u, v;
     bool frontFace;
+    // Object whose surface was hit, an Instance rather than what it places
+    const Hittable *object;
 
     void setFaceNormal(const Ray &ray, const glm::vec3 &outwardNormal);
 };
 
+// Outgoing direction picked by Material::sample
+struct BSDFSample
+{
+    // Unit vector leaving the surface
+    glm::vec3 direction;
+    // BSDF times cosine over pdf, what the path throughput is scaled by
+    glm::vec3 weight;
+    // Solid angle density of direction, zero for delta lobes such as
+    // mirrors and glass, which light sampling cannot reach
+    float pdf;
+};
+
+// Shading queue a material is grouped into by the wavefront integrator
+enum class MaterialType
+{
+    LAMBERTIAN,
+    METAL,
+    DIELECTRIC,
+    DIFFUSE_LIGHT,
+    COUNT
+};
+
 class Material
 {
 public:
@@ -29,7 +59,35 @@ public:
         return glm::vec3(0, 0, 0);
     }
 
-    virtual bool scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const = 0;
+    // Surface colour without lighting, guides the denoiser
+    virtual glm::vec3 albedo(const HitPayload &payload) const
+    {
+        return glm::vec3(1.0f);
+    }
+
+    // Surfaces with this material are collected as area lights
+    virtual bool isEmissive() const
+    {
+        return false;
+    }
+
+    // Importance samples the direction a path continues in, wo pointing back
+    // along the incoming ray. False absorbs the path.
+    virtual bool sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const = 0;
+
+    // BSDF times the cosine at the surface, for light arriving along wi and
+    // leaving along wo (back towards the ray origin). Both are unit vectors.
+    virtual glm::vec3 eval(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const
+    {
+        return glm::vec3(0.0f);
+    }
+    // Solid angle density of sample() choosing wi. Zero for materials that
+    // cannot be evaluated (mirrors, glass), they receive no light samples.
+    virtual float pdf(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const
+    {
+        return 0.0f;
+    }
+    virtual MaterialType getType() const = 0;
     virtual bool renderUI()
     {
         return false;
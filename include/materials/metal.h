@@ -6,10 +6,24 @@ class Metal : public Material
 public:
     Metal(const std::shared_ptr<Texture> &texture, float fuzz);
     Metal(const glm::vec3 &albedo, float fuzz);
-    virtual bool scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const override;
+    virtual bool sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const override;
+    virtual glm::vec3 eval(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const override;
+    virtual float pdf(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const override;
+    virtual glm::vec3 albedo(const HitPayload &payload) const override;
+    virtual MaterialType getType() const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
 public:
     std::shared_ptr<Texture> texture;
+    // Glossiness in [0, 1], 0 is a perfect mirror
     float fuzz;
+
+private:
+    // Below this the lobe is treated as a perfect mirror
+    static constexpr float minFuzz = 1e-3f;
+
+    // Phong exponent of the lobe around the mirror direction for fuzz
+    float getExponent() const;
 };
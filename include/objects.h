@@ -1,5 +1,7 @@
 #pragma once
 
+#include "objects/instance.h"
 #include "objects/plane.h"
 #include "objects/sphere.h"
-#include "objects/triangle.h"
\ No newline at end of file
+#include "objects/triangle.h"
+#include "objects/triangleMesh.h"
\ No newline at end of file
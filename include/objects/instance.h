@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include "glm/glm.hpp"
+#include "hittable.h"
+
+// Places a shared object in the scene through an object-to-world transform,
+// so a mesh and its BVH are stored once however many times it appears. The
+// scene BVH over instances is the top level, the mesh BVH the bottom one.
+// Rays are moved into object space instead of the geometry into world space.
+// Instances of instances are not supported.
+class Instance : public Hittable
+{
+public:
+    glm::vec3 position;
+    // Euler angles in degrees, applied as X then Y then Z
+    glm::vec3 rotation;
+    glm::vec3 scale;
+
+    Instance(const std::string &name, std::shared_ptr<const Hittable> object, glm::vec3 position = glm::vec3(0.0f),
+             glm::vec3 rotation = glm::vec3(0.0f), glm::vec3 scale = glm::vec3(1.0f));
+
+    // Recomputes the cached matrices after position, rotation or scale changed
+    void updateTransform();
+
+    const std::shared_ptr<const Hittable> &getObject() const;
+
+    virtual bool intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const override;
+    virtual void computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const override;
+    virtual bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    virtual uint64_t intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const override;
+    virtual bool boundingBox(AABB &outputBox) const override;
+    virtual bool material(uint32_t &outputId) const override;
+#ifndef RAYZ_HEADLESS
+    virtual bool renderUI() override;
+#endif
+
+private:
+    std::shared_ptr<const Hittable> object;
+
+    glm::mat4 objectToWorld;
+    // World to object as a linear part plus translation, directions only
+    // need the former. Rays keep their parameter t in both spaces.
+    glm::mat3 worldToObjectLinear;
+    glm::vec3 worldToObjectTranslation;
+    // Inverse transpose of the linear part of objectToWorld
+    glm::mat3 normalToWorld;
+
+    Ray toObject(const Ray &ray) const;
+};
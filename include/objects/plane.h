@@ -14,15 +14,19 @@ private:
 public:
     glm::vec3 position;
     glm::vec3 normal;
-    std::shared_ptr<Material> mat;
+    uint32_t materialId;
     int normalKind;
 
     // Plane(const std::string &name);
-    Plane(const std::string &name, glm::vec3 position, glm::vec3 normal, std::shared_ptr<Material> mat);
+    Plane(const std::string &name, glm::vec3 position, glm::vec3 normal, uint32_t materialId);
 
-    virtual bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    virtual bool intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const override;
+    virtual void computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const override;
     virtual bool boundingBox(AABB &outputox) const override;
+    virtual bool material(uint32_t &outputId) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
     // static std::shared_ptr<Hittable> CreatePlane(const std::string &name);
 };
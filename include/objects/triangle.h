@@ -9,13 +9,20 @@ class Triangle : public Hittable
 {
 public:
     glm::vec3 v0, v1, v2;
-    std::shared_ptr<Material> mat;
+    uint32_t materialId;
 
-    Triangle(const std::string &name, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, std::shared_ptr<Material> mat);
+    Triangle(const std::string &name, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, uint32_t materialId);
 
-    virtual bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    virtual bool intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const override;
+    virtual void computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const override;
     virtual bool boundingBox(AABB &outputox) const override;
+    virtual bool material(uint32_t &outputId) const override;
+    virtual uint32_t getSampleablePrimitiveCount() const override;
+    virtual float getPrimitiveArea(uint32_t primitiveId) const override;
+    virtual void samplePrimitive(uint32_t primitiveId, const glm::vec2 &u, glm::vec3 &position, glm::vec3 &normal, glm::vec2 &uv) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
     // static std::shared_ptr<Hittable> CreateTriangle(const std::string &name);
 };
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+#include "hittable.h"
+#include "bvh.h"
+#include "triangleBlock.h"
+#include "materials/material.h"
+
+// Indexed triangle soup with shared vertex attributes and its own BVH over
+// the triangles, so a whole asset is a single scene object
+class TriangleMesh : public Hittable
+{
+public:
+    std::vector<glm::vec3> positions;
+    // Optional, either empty or one per position
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    // Three per triangle
+    std::vector<uint32_t> indices;
+    uint32_t materialId;
+
+    TriangleMesh(const std::string &name, std::vector<glm::vec3> positions, std::vector<glm::vec3> normals,
+                 std::vector<glm::vec2> uvs, std::vector<uint32_t> indices, uint32_t materialId);
+
+    // Rebuilds the triangle BVH and leaf blocks after the buffers changed
+    void build();
+
+    uint32_t getTriangleCount() const;
+    const BVH::BuildStats &getBuildStats() const;
+
+    virtual bool intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const override;
+    virtual void computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const override;
+    virtual bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    virtual uint64_t intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const override;
+    virtual bool boundingBox(AABB &outputBox) const override;
+    virtual bool material(uint32_t &outputId) const override;
+    virtual uint32_t getSampleablePrimitiveCount() const override;
+    virtual float getPrimitiveArea(uint32_t primitiveId) const override;
+    virtual void samplePrimitive(uint32_t primitiveId, const glm::vec2 &u, glm::vec3 &position, glm::vec3 &normal, glm::vec2 &uv) const override;
+#ifndef RAYZ_HEADLESS
+    virtual bool renderUI() override;
+#endif
+
+    // Wavefront OBJ, polygons are fan triangulated. Returns nullptr on failure.
+    static std::shared_ptr<TriangleMesh> LoadOBJ(const std::string &name, const std::string &filePath, uint32_t materialId);
+
+private:
+    BVH bvh;
+    AABB bounds;
+    // Leaf triangles repacked for the wide kernels, leafBlocks maps a leaf
+    // node to its first block
+    std::vector<TriangleBlock> blocks;
+    std::vector<uint32_t> leafBlocks;
+};
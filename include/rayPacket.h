@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "glm/glm.hpp"
+
+#include "ray.h"
+
+// Up to 64 rays leaving the same origin, an 8x8 block of primary rays. When
+// every direction has the same sign per axis the packet also carries the
+// range of its inverse directions, so a node box can be rejected for the
+// whole packet with one interval slab test.
+struct RayPacket
+{
+    static constexpr uint32_t edge = 8;
+    static constexpr uint32_t size = edge * edge;
+
+    glm::vec3 origin;
+    glm::vec3 directions[size];
+    glm::vec3 invDirections[size];
+    // Closest hit so far per ray, intersectPacket shrinks these
+    float tMax[size];
+    uint32_t count = 0;
+
+    bool coherent = false;
+    glm::vec3 invDirectionMin, invDirectionMax;
+
+    void add(const glm::vec3 &direction)
+    {
+        directions[count] = direction;
+        invDirections[count] = 1.0f / direction;
+        tMax[count] = std::numeric_limits<float>::max();
+        count++;
+    }
+
+    // Computes the interval bounds once all rays are added
+    void finalize()
+    {
+        coherent = count > 0;
+        invDirectionMin = invDirectionMax = count ? invDirections[0] : glm::vec3(0.0f);
+        for (uint32_t i = 0; i < count && coherent; i++)
+        {
+            for (int a = 0; a < 3; a++)
+                if (directions[i][a] == 0.0f || (directions[i][a] > 0.0f) != (directions[0][a] > 0.0f))
+                    coherent = false;
+            invDirectionMin = glm::min(invDirectionMin, invDirections[i]);
+            invDirectionMax = glm::max(invDirectionMax, invDirections[i]);
+        }
+    }
+
+    Ray getRay(uint32_t i) const
+    {
+        return {origin, directions[i]};
+    }
+};
@@ -1,17 +1,43 @@
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <memory>
 
+#include <string>
+
 #include "glm/glm.hpp"
+#ifndef RAYZ_HEADLESS
 #include "jug/image.h"
+#endif
 
 #include "camera.h"
 #include "ray.h"
 #include "hittable.h"
 #include "scene.h"
+#include "tileScheduler.h"
+#include "wavefront.h"
+#include "denoiser.h"
+#include "tonemapper.h"
 
+#ifndef RAYZ_HEADLESS
 using namespace Jug;
+#endif
+
+// Per pixel outputs besides the beauty image. Albedo, normal and depth are
+// taken at the first rough surface like the denoiser's features, the IDs at
+// the camera ray's hit.
+enum class AOV
+{
+    BEAUTY,
+    ALBEDO,
+    NORMAL,
+    DEPTH,
+    MATERIAL_ID,
+    OBJECT_ID,
+    SAMPLE_COUNT,
+    COUNT
+};
 
 class Renderer
 {
@@ -21,11 +47,70 @@ public:
         bool accumulate = true;
         int maxFrames = 1000;
         glm::vec3 backgroundColor = glm::vec3(0.5f, 0.7f, 1.0f);
+
+        // Square bucket edge in pixels and render threads, 0 = all cores
+        int tileSize = 32;
+        int workerCount = 0;
+
+        // Random sub-pixel camera ray offsets, anti-aliases the accumulation
+        bool jitter = true;
+        // Trace camera rays as 8x8 packets, bounces stay single rays
+        bool primaryPackets = true;
+        // Breadth first integrator with per-material shading passes
+        bool wavefront = false;
+        // Sample a point on an emitter at every bounce and trace a shadow ray
+        // to it, MIS weighted against hitting lights by scattering
+        bool nextEventEstimation = true;
+        // Paths end at maxDepth segments. From rouletteDepth on, each bounce
+        // may end them early with a probability that grows as their
+        // throughput falls, the survivors are reweighted to stay unbiased.
+        int maxDepth = 10;
+        int rouletteDepth = 3;
+
+        // Tiles stop sampling once the relative standard error of their worst
+        // pixel is below this, the remaining tiles get their share of the
+        // frame. 0, the default, samples every pixel every frame, as does the
+        // wavefront mode.
+        float noiseThreshold = 0.0f;
+        int adaptiveMinSamples = 16;
+
+        // While the camera or scene changes, trace one pixel in stride x
+        // stride and replicate it, with the stride picked to fit the frame
+        // budget. Refines back to full resolution once things stay still.
+        bool dynamicResolution = true;
+        float frameBudget = 33.0f;
+
+        // Filter the accumulated image guided by first hit features, see
+        // Denoiser for its own settings. While accumulating the filter runs at
+        // 1, 2, 4... samples and then every denoiseInterval frames, 0 leaves
+        // it to saveImage.
+        bool denoise = false;
+        int denoiseInterval = 8;
+
+        // Mask of 1 << AOV bits saved next to the beauty image. Gathering
+        // any AOV, or denoising, restarts accumulation once.
+        uint32_t aovs = 0;
+        // Shown in the viewport instead of the beauty image
+        AOV displayAOV = AOV::BEAUTY;
+
+        // While accumulating, write a checkpoint to this path every
+        // checkpointInterval seconds, empty for none
+        std::string checkpointPath;
+        float checkpointInterval = 300.0f;
     };
 
     struct Status
     {
         int currentSample = 0;
+        // Fraction of the pixels still sampled by adaptive sampling
+        float activeFraction = 1.0f;
+        // Pixel stride of the last frame, 1 at full resolution
+        uint32_t previewStride = 1;
+        TileScheduler::Stats tiles;
+        // Only filled while Settings::wavefront is on
+        WavefrontIntegrator::Stats wavefront;
+        // Only filled while Settings::denoise is on
+        Denoiser::Stats denoiser;
     };
 
     Renderer();
@@ -33,29 +118,144 @@ public:
     void render(const Scene &scene, const Camera &camera);
     void resetFrameIndex();
 
+#ifndef RAYZ_HEADLESS
     void renderUI();
     void saveImage();
+#endif
+    // The beauty image tonemapped as a PNG, or for .exr and .pfm paths the
+    // linear radiance as 32 bit floats, whichever AOV is displayed. Denoises
+    // first if the filter is on and has not seen the latest samples.
+    bool saveImage(const std::string &filePath);
+
+    static const char *getAOVName(AOV aov);
+    // Raw per pixel values: colours, normals in [-1, 1], depth in x, IDs in
+    // x (-1 for none) and the sample count in x
+    void getAOV(AOV aov, std::vector<glm::vec4> &values) const;
+    // Writes every AOV in Settings::aovs named after the beauty image, e.g.
+    // render.normal.png next to render.png. EXR and PFM beauty paths get raw
+    // float AOVs in the same format, PNG ones viewable colours.
+    bool saveAOVs(const std::string &beautyPath) const;
+
+    // Radiance sums, sample counts and features together with the scene
+    // hash, camera and sampling settings they were made with. Written to a
+    // temporary file that is then renamed over filePath, so an interrupted
+    // write leaves the previous checkpoint intact.
+    bool saveCheckpoint(const std::string &filePath, const Scene &scene, const Camera &camera) const;
+    // Continues accumulating from a checkpoint, call after onResize to its
+    // size. Fails if the scene, camera or settings differ, or if denoising
+    // or AOVs need features the checkpoint did not capture. The reason is
+    // printed and shown in the UI.
+    bool loadCheckpoint(const std::string &filePath, const Scene &scene, const Camera &camera);
 
     Settings &getSettings();
+    Denoiser::Settings &getDenoiserSettings();
+    // Call after changing these so the image is resolved again
+    Tonemapper::Settings &getTonemapperSettings();
+    void invalidateDisplay();
     Status getStatus();
+    const std::vector<Tile> &getTiles() const;
 
+    uint32_t getWidth() const;
+    uint32_t getHeight() const;
+    const uint32_t *getImageData() const;
+
+#ifndef RAYZ_HEADLESS
     std::shared_ptr<Image>
     getFinalImage();
+#endif
 
 private:
-    const Camera *activeCamera;
-    const Scene *activeScene;
+    const Camera *activeCamera = nullptr;
+    const Scene *activeScene = nullptr;
     Settings settings;
 
+#ifndef RAYZ_HEADLESS
     std::shared_ptr<Image> finalImage;
+#endif
+    uint32_t width = 0, height = 0;
+    // Display pixels, only rewritten by the resolve passes
     uint32_t *imageDataToTexture = nullptr;
-    glm::vec4 *accumulationData = nullptr;
+    // Radiance sums and the samples each pixel holds, pixels can differ
+    glm::vec3 *accumulationData = nullptr;
+    uint32_t *sampleCounts = nullptr;
+    // Sum of squared sample luminance, for the variance estimate
+    float *squaredLuminance = nullptr;
+    // Sums of the first hit features, for the denoiser
+    PixelFeatures *featureData = nullptr;
 
     int frameIndex = 1;
+    // Frames rendered since construction, never reset. While accumulation
+    // is off, sample seeds are offset by it times the most samples a frame
+    // can take.
+    uint32_t renderedFrames = 0;
+    uint32_t sampleSeedOffset = 0;
+
+    // Worst pixel error per scheduler tile and samples each active tile
+    // takes this frame
+    static constexpr uint32_t maxAdaptivePasses = 8;
+    std::vector<float> tileErrors;
+    uint32_t adaptivePasses = 1;
+    float activeFraction = 1.0f;
+
+    // Set by resetFrameIndex until the next frame, previewStrideTarget is the
+    // stride expected to meet the frame budget
+    static constexpr uint32_t maxPreviewStride = 16;
+    bool changing = true;
+    uint32_t previewStride = 1;
+    float previewStrideTarget = 4.0f;
+
+    TileScheduler scheduler;
+    WavefrontIntegrator wavefront;
+    Denoiser denoiser;
+    Tonemapper tonemapper;
+    // Per scheduler tile, set when a tile takes samples and cleared once
+    // resolveImage has written its display pixels
+    std::vector<uint8_t> dirtyTiles;
+    // Set when the denoised image misses samples or settings, the display
+    // catches up at the next scheduled run unless denoiseRequested
+    bool denoiseDirty = false;
+    bool denoiseRequested = false;
+    int framesSinceDenoise = 0;
+    // Whether paths record PixelFeatures, see Settings::aovs
+    bool captureFeatures = false;
+    std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+    // Outcome of the last checkpoint resume, or save from the UI
+    std::string checkpointStatus;
 
-    std::vector<int> verticalIterator, horizontalIterator;
+    void renderFrame();
+    bool wantsFeatures() const;
+    // Tonemaps the accumulation of every dirty tile into the display pixels
+    void resolveImage();
+    bool isDenoiseDue(bool tracing) const;
+    // Replaces the displayed image with the denoised accumulation
+    void denoiseImage();
+    void displayAOV();
+    glm::vec4 getAOVPixel(AOV aov, uint32_t index) const;
+    // getAOV mapped to [0, 1] colours for display and PNG output
+    void getAOVImage(AOV aov, std::vector<uint32_t> &pixels) const;
+    // Streams the AOV a row at a time, extension picks EXR or PFM
+    bool saveFloatImage(const std::string &filePath, const std::string &extension, AOV aov) const;
+    void renderPreview(uint32_t stride);
+    void renderPreviewTile(const Tile &tile, uint32_t stride);
+    void prepareAdaptiveSampling();
+    // Adaptively converged or holding maxFrames - 1 samples already
+    bool isTileConverged(uint32_t tileIndex) const;
+    bool isTileCapped(const Tile &tile) const;
+    float estimateTileError(const Tile &tile) const;
+    // Sample index of the pixel's next sample, what the cap counts
+    uint32_t getSampleIndex(uint32_t x, uint32_t y) const;
+    // The same plus sampleSeedOffset, seeds the pixel's random streams
+    uint32_t getSampleSeed(uint32_t x, uint32_t y) const;
 
-    glm::vec4 perPixel(int x, int y);
+    void renderTile(const Tile &tile);
+    void renderTileSample(const Tile &tile);
+    void renderPacket(uint32_t x, uint32_t y, uint32_t packetWidth, uint32_t packetHeight);
+    // Camera rays of count pixels along a row, jittered per settings
+    void generateCameraRays(uint32_t x, uint32_t y, uint32_t count, glm::vec3 *directions) const;
+    glm::vec3 perPixel(int x, int y, const glm::vec3 &direction, PixelFeatures &features);
+    // Continues a path whose first hit is already known
+    glm::vec3 tracePath(int x, int y, Ray ray, bool hit, HitPayload &payload, PixelFeatures &features);
+    void accumulatePixel(uint32_t x, uint32_t y, const glm::vec3 &color, const PixelFeatures &features);
     // HitPayload traceRay(const Ray &ray);
     // HitPayload closetHit(const Ray &ray, float hitDistance, int objectIndex);
     // HitPayload miss(const Ray &ray);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+
+// PCG32 generator owned by a single path. The stream is picked by the pixel
+// and every bounce reseeds from (pixel, sample, bounce), so sequences do not
+// depend on thread scheduling and need no shared state.
+class Sampler
+{
+public:
+    Sampler(uint32_t pixel, uint32_t sample)
+        : pixel(pixel), sample(sample)
+    {
+        startBounce(0);
+    }
+
+    // Bounce index of the stream that jitters the camera ray
+    static constexpr uint32_t cameraBounce = ~0u;
+
+    void startBounce(uint32_t bounce)
+    {
+        increment = ((uint64_t)pixel << 1) | 1u;
+        state = 0;
+        nextUInt();
+        state += mix(((uint64_t)sample << 32) | bounce);
+        nextUInt();
+    }
+
+    uint32_t nextUInt()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        uint32_t xorShifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+    }
+
+    // Uniform in [0, 1)
+    float nextFloat()
+    {
+        return (nextUInt() >> 8) * 0x1p-24f;
+    }
+
+    glm::vec2 next2D()
+    {
+        float u = nextFloat();
+        return glm::vec2(u, nextFloat());
+    }
+
+    // Uniform direction on the unit sphere
+    glm::vec3 unitVector()
+    {
+        glm::vec2 u = next2D();
+        float z = 1.0f - 2.0f * u.x;
+        float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+        float phi = 2.0f * glm::pi<float>() * u.y;
+        return glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+    }
+
+    // Direction around the unit vector axis whose cosine to it is
+    // distributed as cos^exponent, density (exponent + 1) / 2pi * cos^exponent.
+    // An exponent of one is the cosine weighted hemisphere.
+    glm::vec3 powerCosineDirection(const glm::vec3 &axis, float exponent)
+    {
+        glm::vec2 u = next2D();
+        float cosine = glm::pow(u.x, 1.0f / (exponent + 1.0f));
+        float sine = glm::sqrt(glm::max(0.0f, 1.0f - cosine * cosine));
+        float phi = 2.0f * glm::pi<float>() * u.y;
+
+        // Orthonormal basis without normalisation (Duff et al. 2017)
+        float sign = axis.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + axis.z);
+        float b = axis.x * axis.y * a;
+        glm::vec3 tangent(1.0f + sign * axis.x * axis.x * a, sign * b, -sign * axis.x);
+        glm::vec3 bitangent(b, sign + axis.y * axis.y * a, -axis.y);
+        return sine * glm::cos(phi) * tangent + sine * glm::sin(phi) * bitangent + cosine * axis;
+    }
+
+    // Russian roulette: a path survives with probability given by its
+    // brightest throughput channel, capped so bright paths still end. The
+    // survivor's throughput is divided by it, keeping the estimate unbiased.
+    bool survivesRoulette(glm::vec3 &throughput)
+    {
+        float probability = glm::min(glm::max(throughput.r, glm::max(throughput.g, throughput.b)), 0.95f);
+        if (nextFloat() >= probability)
+            return false;
+
+        throughput /= probability;
+        return true;
+    }
+
+private:
+    uint64_t state, increment;
+    uint32_t pixel, sample;
+
+    // splitmix64 finaliser
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+};
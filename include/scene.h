@@ -1,7 +1,21 @@
 #pragma once
 
+#include <unordered_map>
+
 #include "materials/material.h"
 #include "hittable.h"
+#include "bvh.h"
+#include "emitters.h"
+
+// Light sample of next event estimation before its visibility is known
+struct ShadowRay
+{
+    Ray ray;
+    // Visible between 0.001 and tMax along ray
+    float tMax;
+    // Radiance added if nothing blocks the ray, MIS weight included
+    glm::vec3 contribution;
+};
 
 class Scene : public Hittable
 {
@@ -12,23 +26,90 @@ private:
         NONE,
         SPHERE,
         PLANE,
-        TRIANGLE
+        TRIANGLE,
+        MESH
     };
 
     Scene::OBJECTS currentAdding = Scene::OBJECTS::NONE;
 
+    // Objects with a bounding box live in the BVH, the rest (infinite planes)
+    // are tested one by one next to it
+    BVH bvh;
+    std::vector<const Hittable *> boundedObjects;
+    std::vector<const Hittable *> unboundedObjects;
+    bool dirty = true;
+
+    // BVH primitive of every object (noPrimitive if unbounded) and the boxes
+    // the tree was last fitted to, so edits only refit what moved
+    static constexpr uint32_t noPrimitive = ~0u;
+    std::vector<uint32_t> objectPrimitives;
+    std::vector<AABB> primitiveBounds;
+    std::vector<uint32_t> editedObjects;
+    // Queues the object and every instance of it for the next refit
+    void markEdited(uint32_t objectIndex);
+    // Position in objects of every top level object, for object ID AOVs
+    std::unordered_map<const Hittable *, uint32_t> objectIndices;
+
+    // Area lights, gathered again whenever objects change
+    EmitterList emitters;
+    void buildEmitters();
+
+    // Sole owner of the materials, hits refer to them by index
+    std::vector<std::shared_ptr<Material>> materials;
+
 public:
     Scene(const std::string &name);
     Scene(const std::string &name, const std::shared_ptr<Hittable> &object);
 
     void clear();
     void add(const std::shared_ptr<Hittable> &object);
+    uint32_t addMaterial(const std::shared_ptr<Material> &material);
+
+    const Material *getMaterial(uint32_t materialId) const
+    {
+        return materials[materialId].get();
+    }
+    uint32_t getMaterialCount() const;
+
+    // Populates the demo scene shared by the viewer and rayz_cli
+    void loadDefault();
+
+    // Rebuilds the acceleration structure after objects were added, or refits
+    // it after objects were edited. Returns true if anything changed.
+    bool update();
+    void build();
+    void refit();
+    const BVH::BuildStats &getBuildStats() const;
 
     const std::vector<std::shared_ptr<Hittable>> &getObjects() const;
+    // Index of a top level object as of the last build, noObject otherwise
+    static constexpr uint32_t noObject = ~0u;
+    uint32_t getObjectIndex(const Hittable *object) const;
+    // Fingerprint of the top level objects, their bounds and the material
+    // types. Material parameters are not part of it.
+    uint64_t getHash() const;
+    const EmitterList &getEmitters() const;
+
+    // Next event estimation at a surface with the given material: samples a
+    // point on an emitter, traces the shadow ray and returns the radiance it
+    // contributes, MIS weighted against the material's own sampling
+    glm::vec3 sampleDirectLight(const Ray &ray, const HitPayload &payload, const Material *material, Sampler &sampler) const;
+    // sampleDirectLight up to the shadow ray, false if the sample cannot
+    // contribute. Lets callers trace the shadow rays as a batch.
+    bool sampleShadowRay(const Ray &ray, const HitPayload &payload, const Material *material, Sampler &sampler, ShadowRay &shadowRay) const;
+    // MIS weight of emission hit by a ray that scattered with density
+    // bsdfPdf, the counterpart of sampleDirectLight. One for delta
+    // scattering (bsdfPdf of zero) and for surfaces that are not listed.
+    float getEmissionWeight(const Ray &ray, const HitPayload &payload, float bsdfPdf) const;
 
-    virtual bool hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const override;
+    virtual bool intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const override;
+    virtual void computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const override;
+    virtual bool occluded(const Ray &ray, float tMin, float tMax) const override;
+    virtual uint64_t intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const override;
     virtual bool boundingBox(AABB &outputox) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
     std::vector<std::shared_ptr<Hittable>> objects;
 };
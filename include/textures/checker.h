@@ -11,5 +11,7 @@ public:
     CheckerTexture(const std::shared_ptr<Texture> &odd, const std::shared_ptr<Texture> &even);
 
     virtual glm::vec3 value(float u, float v, const glm::vec3 &p) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 };
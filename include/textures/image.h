@@ -12,7 +12,9 @@ public:
     ~ImageTexture();
 
     virtual glm::vec3 value(float u, float v, const glm::vec3 &p) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
 private:
     unsigned char *data;
@@ -11,7 +11,9 @@ public:
     NoiseTexture(std::shared_ptr<Texture> texture, float scale);
 
     virtual glm::vec3 value(float u, float v, const glm::vec3 &p) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 
 private:
     static float turbulence(const glm::vec3 &p, int depth = 7);
@@ -8,5 +8,7 @@ public:
     SolidColor(const glm::vec3 &color);
 
     virtual glm::vec3 value(float u, float v, const glm::vec3 &p) const override;
+#ifndef RAYZ_HEADLESS
     virtual bool renderUI() override;
+#endif
 };
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile
+{
+    uint32_t x, y;
+    uint32_t width, height;
+
+    // Wall time of the last run over this tile, in milliseconds
+    float renderTime = 0.0f;
+};
+
+// Persistent worker pool that hands out image tiles in Morton order. Every
+// worker owns a contiguous run of tiles in its own deque and steals from the
+// back of the others once it runs dry, so neighbouring tiles stay on one core.
+class TileScheduler
+{
+public:
+    struct Stats
+    {
+        int tileCount = 0;
+        int steals = 0;
+        float minTileTime = 0.0f;
+        float averageTileTime = 0.0f;
+        float maxTileTime = 0.0f;
+    };
+
+    TileScheduler();
+    ~TileScheduler();
+
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+
+    // 0 picks std::thread::hardware_concurrency
+    void setWorkerCount(uint32_t count);
+    uint32_t getWorkerCount() const;
+
+    void setTiles(uint32_t width, uint32_t height, uint32_t tileSize);
+    const std::vector<Tile> &getTiles() const;
+
+    // Runs job(tile, worker) over every tile and blocks until all are done
+    void run(const std::function<void(const Tile &, uint32_t)> &job);
+
+    // Runs job(begin, end, worker) over [0, count) in chunks of grain items
+    void parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t, uint32_t, uint32_t)> &job);
+
+    Stats getStats() const;
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> jobs;
+    };
+
+    std::vector<Tile> tiles;
+    uint32_t imageWidth = 0, imageHeight = 0, tileSize = 0;
+
+    uint32_t workerCount = 0;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    std::mutex dispatchMutex;
+    std::condition_variable dispatchCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation = 0;
+    uint32_t finishedWorkers = 0;
+    bool stopping = false;
+
+    const std::function<void(uint32_t, uint32_t)> *currentJob = nullptr;
+    std::atomic<int> steals{0};
+    Stats stats;
+
+    void startWorkers(uint32_t count);
+    void stopWorkers();
+    void workerLoop(uint32_t worker, uint64_t seenGeneration);
+
+    void dispatch(uint32_t jobCount, const std::function<void(uint32_t, uint32_t)> &job);
+    void process(uint32_t worker);
+    bool popJob(uint32_t worker, uint32_t &job);
+
+    static uint32_t mortonCode(uint32_t x, uint32_t y);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+// Maps linear radiance to display pixels: exposure, a tone curve and the
+// sRGB transfer function, packed as ABGR like the texture upload expects.
+class Tonemapper
+{
+public:
+    enum class Curve
+    {
+        // Clamped at 1, matches the old output apart from the encoding
+        LINEAR,
+        // Narkowicz's fit of the ACES filmic reference transform
+        ACES
+    };
+
+    struct Settings
+    {
+        // In stops, 0 leaves the radiance as it is
+        float exposure = 0.0f;
+        Curve curve = Curve::ACES;
+    };
+
+    // Resolves count pixels of sums, divided by their sample counts first.
+    // Without counts the colours are taken as they are.
+    void resolveRow(const glm::vec3 *sums, const uint32_t *sampleCounts, uint32_t count, uint32_t *pixels) const;
+
+    Settings &getSettings();
+
+private:
+    Settings settings;
+};
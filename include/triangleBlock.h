@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "ray.h"
+
+// Up to eight triangles in structure-of-arrays form with the first vertex and
+// both edges precomputed, so a BVH leaf is tested with one wide kernel call.
+// Unused lanes hold degenerate triangles that can never be hit.
+struct alignas(32) TriangleBlock
+{
+    static constexpr uint32_t width = 8;
+
+    float v0x[width], v0y[width], v0z[width];
+    float e1x[width], e1y[width], e1z[width];
+    float e2x[width], e2y[width], e2z[width];
+    // Caller side triangle index of each lane
+    uint32_t triangle[width];
+    uint32_t count;
+
+    TriangleBlock();
+
+    void set(uint32_t lane, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, uint32_t triangleIndex);
+
+    // Nearest hit inside [tMin, tMax] over the whole block. Returns the lane
+    // or -1 and fills t and the barycentrics of v1 and v2.
+    int intersect(const Ray &ray, float tMin, float tMax, float &t, float &u, float &v) const;
+
+    // Kernel picked at startup from the CPU features, "AVX2", "SSE" or "Scalar"
+    static const char *getKernelName();
+};
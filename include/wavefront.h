@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "camera.h"
+#include "denoiser.h"
+#include "scene.h"
+#include "tileScheduler.h"
+
+// Breadth first alternative to Renderer::perPixel. One sample of every pixel
+// is advanced a bounce at a time: the extension pass intersects all live
+// paths, the shading pass runs over them one material type at a time and
+// queues their light samples, then the shadow pass traces those. Each pass
+// keeps one kind of work hot in the caches. Path state is kept as
+// structure-of-arrays indexed by pixel.
+class WavefrontIntegrator
+{
+public:
+    struct Stats
+    {
+        // Milliseconds spent in each pass over the whole last frame
+        float extendTime = 0.0f;
+        float sortTime = 0.0f;
+        float shadeTime = 0.0f;
+        float shadowTime = 0.0f;
+        // Total ray segments and shadow rays traced in the last frame
+        uint32_t pathSegments = 0;
+        uint32_t shadowRays = 0;
+        uint32_t bounces = 0;
+    };
+
+    // Per frame knobs mirrored from Renderer::Settings
+    struct Options
+    {
+        // Jitter camera rays like the megakernel does
+        bool jitter = true;
+        // Sample lights with shadow rays while shading
+        bool nextEventEstimation = true;
+        // Russian roulette from rouletteDepth on, hard stop at maxDepth
+        int rouletteDepth = 3;
+        int maxDepth = 10;
+        glm::vec3 backgroundColor = glm::vec3(0.0f);
+        // Record PixelFeatures for the denoiser and AOVs
+        bool features = false;
+        // Added to every sample index that seeds a stream
+        uint32_t sampleOffset = 0;
+    };
+
+    // Traces one sample per pixel, readable through getRadiance afterwards.
+    // sampleCounts holds the samples each pixel has so far, the next sample
+    // index seeds its streams like Renderer::getSampleIndex.
+    void render(const Scene &scene, const Camera &camera, uint32_t width, uint32_t height, const uint32_t *sampleCounts, const Options &options,
+                TileScheduler &scheduler);
+
+    const glm::vec3 *getRadiance() const;
+    // First hit features of the same samples
+    const PixelFeatures *getFeatures() const;
+    const Stats &getStats() const;
+
+private:
+    std::vector<glm::vec3> origins, directions;
+    // Sub-pixel offsets of the camera rays
+    std::vector<glm::vec2> cameraOffsets;
+    std::vector<glm::vec3> attenuations, radiance;
+    // Density of the last scattered direction, for MIS on emitter hits
+    std::vector<float> bsdfPdfs;
+    std::vector<PixelFeatures> features;
+    // Paths that only scattered off delta lobes so far still record features
+    std::vector<uint8_t> recordingFeatures;
+    std::vector<HitPayload> hits;
+    std::vector<uint8_t> hitFlags, alive;
+    // Light sample queued by the shading pass, valid where hasShadowRay
+    std::vector<ShadowRay> shadowRays;
+    std::vector<uint8_t> hasShadowRay;
+
+    // Live path indices in pixel order, the same bucketed by material and
+    // the paths with a shadow ray to trace
+    std::vector<uint32_t> activePaths, shadeQueue, shadowQueue;
+    std::vector<uint32_t> bucketOffsets;
+    // Bucket of every path, and per sort chunk its count and then its first
+    // slot in each bucket
+    std::vector<uint8_t> pathBuckets;
+    std::vector<uint32_t> chunkOffsets;
+
+    Stats stats;
+
+    void resize(size_t pathCount);
+    void extend(const Scene &scene, TileScheduler &scheduler);
+    void sortByMaterial(const Scene &scene, TileScheduler &scheduler);
+    // Runs each material bucket as its own batch
+    void shade(const Scene &scene, const uint32_t *sampleCounts, int bounce, const Options &options, TileScheduler &scheduler);
+    void shadeMiss(uint32_t path, const Options &options);
+    void shadeHit(const Scene &scene, uint32_t path, const uint32_t *sampleCounts, int bounce, const Options &options);
+    void traceShadowRays(const Scene &scene, TileScheduler &scheduler);
+    void compact();
+};
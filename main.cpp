@@ -14,7 +14,6 @@
 
 #include "camera.h"
 #include "renderer.h"
-// #include "bvhNode.h"
 
 using namespace Jug;
 class RayTracingLayer : public Layer
@@ -23,22 +22,7 @@ public:
     RayTracingLayer()
         : camera(45.0f, 0.1f, 100.0f), scene("Main Scene")
     {
-        auto earthImage = std::make_shared<ImageTexture>("textures/earthmap.jpg");
-        auto earth = std::make_shared<Lambertian>(earthImage);
-
-        // auto per1 = std::make_shared<NoiseTexture>(glm::vec3(1, 1, 1), 1.0f);
-        // auto noiseMat = std::make_shared<Lambertian>(per1);
-        auto metal = std::make_shared<Metal>(glm::vec3(1.0f, 1.0f, 1.0f), 0.5);
-
-        auto emissive = std::make_shared<DiffuseLight>(std::make_shared<NoiseTexture>(glm::vec3(1, 1, 1), 1.0f));
-        auto mirror = std::make_shared<Dieletric>(glm::vec3(1.0f, 1.0f, 1.0f), 2.0f);
-
-        scene.add(std::make_shared<Plane>("P1", glm::vec3(0.0f, -0.6f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), mirror));
-
-        scene.add(std::make_shared<Triangle>("T1", glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), emissive));
-        scene.add(std::make_shared<Triangle>("T2", glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f), emissive));
-    
-        scene.add(std::make_shared<Sphere>("S1", glm::vec3(0.0f, 0.5f, 0.8f), 0.5f, metal));
+        scene.loadDefault();
     }
 
     virtual void OnUpdate(float ts) override
@@ -82,6 +66,7 @@ public:
         Timer timer;
         camera.onResize(viewportWidth, viewportHeight);
         renderer.onResize(viewportWidth, viewportHeight);
+        scene.update();
         renderer.render(scene, camera);
         lastRenderTime = timer.getTimeElapsedMillis();
         frameRate = 100.0f / lastRenderTime;
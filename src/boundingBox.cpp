@@ -23,8 +23,11 @@ bool AABB::hit(const Ray &ray, float tMin, float tMax) const
 {
     for (int i = 0; i < 3; i++)
     {
-        float t0 = glm::min<float>(((minimum[i] - ray.origin[i]) / ray.direction[i]), ((maximum[i] - ray.origin[i]) / ray.direction[i]));
-        float t1 = glm::max<float>(((minimum[i] - ray.origin[i]) / ray.direction[i]), ((maximum[i] - ray.origin[i]) / ray.direction[i]));
+        float invDirection = 1.0f / ray.direction[i];
+        float nearDistance = (minimum[i] - ray.origin[i]) * invDirection;
+        float farDistance = (maximum[i] - ray.origin[i]) * invDirection;
+        float t0 = glm::min(nearDistance, farDistance);
+        float t1 = glm::max(nearDistance, farDistance);
 
         tMin = glm::max(t0, tMin);
         tMax = glm::min(t1, tMax);
@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_reduce.h"
+#include "tbb/task_group.h"
+
+#include "bvh.h"
+
+struct BVH::BuildContext
+{
+    const std::vector<AABB> &primitiveBounds;
+    std::vector<glm::vec3> centroids;
+    uint32_t maxLeafSize;
+
+    // Nodes are preallocated, tasks claim sibling pairs from this counter
+    std::atomic<uint32_t> nodeCount{1};
+    tbb::task_group tasks;
+
+    BuildContext(const std::vector<AABB> &primitiveBounds, uint32_t maxLeafSize)
+        : primitiveBounds(primitiveBounds), centroids(primitiveBounds.size()), maxLeafSize(maxLeafSize)
+    {
+    }
+};
+
+namespace
+{
+    struct Bin
+    {
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        uint32_t count = 0;
+
+        void grow(const AABB &box)
+        {
+            boundsMin = glm::min(boundsMin, box.getMin());
+            boundsMax = glm::max(boundsMax, box.getMax());
+            count++;
+        }
+
+        void merge(const Bin &other)
+        {
+            boundsMin = glm::min(boundsMin, other.boundsMin);
+            boundsMax = glm::max(boundsMax, other.boundsMax);
+            count += other.count;
+        }
+    };
+
+    struct CentroidBounds
+    {
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    };
+}
+
+void BVH::build(const std::vector<AABB> &primitiveBounds, uint32_t maxLeafSize, uint32_t leafBlockSize)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    clear();
+    this->leafBlockSize = std::max(1u, leafBlockSize);
+    if (primitiveBounds.empty())
+        return;
+
+    BuildContext context(primitiveBounds, std::max(1u, maxLeafSize));
+    for (size_t i = 0; i < primitiveBounds.size(); i++)
+        context.centroids[i] = 0.5f * (primitiveBounds[i].getMin() + primitiveBounds[i].getMax());
+
+    primitiveIndices.resize(primitiveBounds.size());
+    std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0);
+
+    nodes.resize(2 * primitiveBounds.size() - 1);
+    nodes[0] = {glm::vec3(0.0f), 0, glm::vec3(0.0f), (uint32_t)primitiveBounds.size()};
+
+    updateBounds(context, 0);
+    subdivide(context, 0, 0);
+    context.tasks.wait();
+
+    nodes.resize(context.nodeCount);
+    collapse();
+    linkNodes();
+
+    computeStats();
+    builtSahCost = stats.sahCost;
+    stats.buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BVH::clear()
+{
+    nodes.clear();
+    wideNodes.clear();
+    primitiveIndices.clear();
+    parents.clear();
+    primitiveLeaves.clear();
+    wideSlots.clear();
+    stats = BuildStats();
+}
+
+bool BVH::refit(const std::vector<AABB> &primitiveBounds, const std::vector<uint32_t> &changedPrimitives)
+{
+    if (nodes.empty())
+        return true;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t primitive : changedPrimitives)
+    {
+        uint32_t nodeIndex = primitiveLeaves[primitive];
+        const BVHNode &leaf = nodes[nodeIndex];
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; i++)
+        {
+            const AABB &box = primitiveBounds[primitiveIndices[i]];
+            boundsMin = glm::min(boundsMin, box.getMin());
+            boundsMax = glm::max(boundsMax, box.getMax());
+        }
+
+        // Ancestors above a node whose bounds did not change are already right
+        bool changed = setNodeBounds(nodeIndex, boundsMin, boundsMax);
+        while (changed && nodeIndex != 0)
+        {
+            nodeIndex = parents[nodeIndex];
+            const BVHNode &left = nodes[nodes[nodeIndex].leftFirst];
+            const BVHNode &right = nodes[nodes[nodeIndex].leftFirst + 1];
+            changed = setNodeBounds(nodeIndex, glm::min(left.boundsMin, right.boundsMin), glm::max(left.boundsMax, right.boundsMax));
+        }
+    }
+
+    float rootArea = surfaceArea(nodes[0].boundsMin, nodes[0].boundsMax);
+    stats.sahCost = rootArea > 0.0f ? weightedArea / rootArea : weightedArea;
+    stats.refitCount++;
+    stats.refitTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return stats.sahCost <= rebuildThreshold * builtSahCost;
+}
+
+bool BVH::empty() const
+{
+    return nodes.empty();
+}
+
+const BVH::BuildStats &BVH::getBuildStats() const
+{
+    return stats;
+}
+
+void BVH::subdivide(BuildContext &context, uint32_t nodeIndex, uint32_t depth)
+{
+    BVHNode &node = nodes[nodeIndex];
+    uint32_t first = node.leftFirst;
+    uint32_t count = node.count;
+    if (count <= 1 || depth >= maxDepth)
+        return;
+
+    int axis;
+    float splitPosition;
+    bool split = findSplit(context, node, axis, splitPosition);
+    if (!split && count <= context.maxLeafSize)
+        return;
+
+    auto begin = primitiveIndices.begin() + first;
+    auto end = begin + count;
+    uint32_t mid = first;
+    if (split)
+        mid = std::partition(begin, end, [&context, axis, splitPosition](uint32_t i)
+                             { return context.centroids[i][axis] < splitPosition; }) -
+              primitiveIndices.begin();
+
+    // Oversized leaf without a usable SAH plane, fall back to the median
+    if (mid == first || mid == first + count)
+    {
+        glm::vec3 extent = node.boundsMax - node.boundsMin;
+        axis = extent.y > extent.x ? 1 : 0;
+        if (extent.z > extent[axis])
+            axis = 2;
+
+        mid = first + count / 2;
+        std::nth_element(begin, primitiveIndices.begin() + mid, end, [&context, axis](uint32_t a, uint32_t b)
+                         { return context.centroids[a][axis] < context.centroids[b][axis]; });
+    }
+
+    uint32_t leftIndex = context.nodeCount.fetch_add(2);
+    nodes[leftIndex] = {glm::vec3(0.0f), first, glm::vec3(0.0f), mid - first};
+    nodes[leftIndex + 1] = {glm::vec3(0.0f), mid, glm::vec3(0.0f), first + count - mid};
+
+    node.leftFirst = leftIndex;
+    node.count = 0;
+
+    updateBounds(context, leftIndex);
+    updateBounds(context, leftIndex + 1);
+
+    if (count > parallelThreshold)
+    {
+        context.tasks.run([this, &context, leftIndex, depth]
+                          { subdivide(context, leftIndex, depth + 1); });
+        subdivide(context, leftIndex + 1, depth + 1);
+    }
+    else
+    {
+        subdivide(context, leftIndex, depth + 1);
+        subdivide(context, leftIndex + 1, depth + 1);
+    }
+}
+
+bool BVH::findSplit(BuildContext &context, const BVHNode &node, int &axis, float &splitPosition) const
+{
+    const uint32_t first = node.leftFirst;
+    const tbb::blocked_range<uint32_t> range(first, first + node.count, parallelThreshold);
+    const bool parallel = node.count > parallelThreshold;
+
+    auto growCentroids = [this, &context](const tbb::blocked_range<uint32_t> &r, CentroidBounds bounds)
+    {
+        for (uint32_t i = r.begin(); i != r.end(); i++)
+        {
+            const glm::vec3 &c = context.centroids[primitiveIndices[i]];
+            bounds.boundsMin = glm::min(bounds.boundsMin, c);
+            bounds.boundsMax = glm::max(bounds.boundsMax, c);
+        }
+        return bounds;
+    };
+    auto mergeCentroids = [](CentroidBounds a, const CentroidBounds &b)
+    {
+        a.boundsMin = glm::min(a.boundsMin, b.boundsMin);
+        a.boundsMax = glm::max(a.boundsMax, b.boundsMax);
+        return a;
+    };
+
+    CentroidBounds centroidBounds = parallel ? tbb::parallel_reduce(range, CentroidBounds(), growCentroids, mergeCentroids)
+                                             : growCentroids(range, CentroidBounds());
+
+    const glm::vec3 extent = centroidBounds.boundsMax - centroidBounds.boundsMin;
+    const glm::vec3 scale = glm::vec3((float)binCount) / glm::max(extent, glm::vec3(1e-20f));
+
+    using Bins = std::array<std::array<Bin, binCount>, 3>;
+    auto growBins = [this, &context, &centroidBounds, &scale](const tbb::blocked_range<uint32_t> &r, Bins bins)
+    {
+        for (uint32_t i = r.begin(); i != r.end(); i++)
+        {
+            uint32_t primitive = primitiveIndices[i];
+            glm::vec3 offset = (context.centroids[primitive] - centroidBounds.boundsMin) * scale;
+            for (int a = 0; a < 3; a++)
+                bins[a][std::min(binCount - 1, (uint32_t)offset[a])].grow(context.primitiveBounds[primitive]);
+        }
+        return bins;
+    };
+    auto mergeBins = [](Bins a, const Bins &b)
+    {
+        for (int i = 0; i < 3; i++)
+            for (uint32_t j = 0; j < binCount; j++)
+                a[i][j].merge(b[i][j]);
+        return a;
+    };
+
+    Bins bins = parallel ? tbb::parallel_reduce(range, Bins(), growBins, mergeBins)
+                         : growBins(range, Bins());
+
+    // Costs are kept multiplied by the node area to survive flat boxes
+    float bestCost = std::numeric_limits<float>::max();
+    for (int a = 0; a < 3; a++)
+    {
+        if (extent[a] <= 0.0f)
+            continue;
+
+        float leftArea[binCount - 1];
+        uint32_t leftCount[binCount - 1];
+        Bin leftBox, rightBox;
+        for (uint32_t i = 0; i < binCount - 1; i++)
+        {
+            leftBox.merge(bins[a][i]);
+            leftArea[i] = leftBox.count ? surfaceArea(leftBox.boundsMin, leftBox.boundsMax) : 0.0f;
+            leftCount[i] = leftBox.count;
+        }
+
+        for (uint32_t i = binCount - 1; i > 0; i--)
+        {
+            rightBox.merge(bins[a][i]);
+            float rightArea = rightBox.count ? surfaceArea(rightBox.boundsMin, rightBox.boundsMax) : 0.0f;
+
+            float cost = leafCost(leftCount[i - 1]) * leftArea[i - 1] + leafCost(rightBox.count) * rightArea;
+            if (leftCount[i - 1] > 0 && rightBox.count > 0 && cost < bestCost)
+            {
+                bestCost = cost;
+                axis = a;
+                splitPosition = centroidBounds.boundsMin[a] + i * extent[a] / binCount;
+            }
+        }
+    }
+
+    if (bestCost == std::numeric_limits<float>::max())
+        return false;
+
+    float nodeArea = surfaceArea(node.boundsMin, node.boundsMax);
+    float splitCost = traversalCost * nodeArea + bestCost;
+    float noSplitCost = leafCost(node.count) * nodeArea;
+    return splitCost < noSplitCost || node.count > context.maxLeafSize;
+}
+
+void BVH::updateBounds(BuildContext &context, uint32_t nodeIndex)
+{
+    BVHNode &node = nodes[nodeIndex];
+    const AABB &firstBox = context.primitiveBounds[primitiveIndices[node.leftFirst]];
+    node.boundsMin = firstBox.getMin();
+    node.boundsMax = firstBox.getMax();
+
+    for (uint32_t i = node.leftFirst + 1; i < node.leftFirst + node.count; i++)
+    {
+        const AABB &box = context.primitiveBounds[primitiveIndices[i]];
+        node.boundsMin = glm::min(node.boundsMin, box.getMin());
+        node.boundsMax = glm::max(node.boundsMax, box.getMax());
+    }
+}
+
+void BVH::computeStats()
+{
+    stats = BuildStats();
+    stats.nodeCount = nodes.size();
+    stats.wideNodeCount = wideNodes.size();
+
+    float rootArea = surfaceArea(nodes[0].boundsMin, nodes[0].boundsMax);
+    float invRootArea = rootArea > 0.0f ? 1.0f / rootArea : 1.0f;
+
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 1}};
+    while (!stack.empty())
+    {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        const BVHNode &node = nodes[index];
+        float relativeArea = surfaceArea(node.boundsMin, node.boundsMax) * invRootArea;
+        stats.maxDepth = std::max(stats.maxDepth, depth);
+
+        if (node.isLeaf())
+        {
+            stats.sahCost += leafCost(node.count) * relativeArea;
+            stats.leafCount++;
+            if (stats.leafSizeHistogram.size() <= node.count)
+                stats.leafSizeHistogram.resize(node.count + 1, 0);
+            stats.leafSizeHistogram[node.count]++;
+        }
+        else
+        {
+            stats.sahCost += traversalCost * relativeArea;
+            stack.push_back({node.leftFirst, depth + 1});
+            stack.push_back({node.leftFirst + 1, depth + 1});
+        }
+    }
+    weightedArea = stats.sahCost * rootArea;
+}
+
+void BVH::collapse()
+{
+    wideNodes.clear();
+    wideSlots.assign(nodes.size(), noSlot);
+    if (nodes.empty() || nodes[0].isLeaf())
+        return;
+
+    wideNodes.reserve(nodes.size() / 2);
+    collapseNode(0);
+}
+
+uint32_t BVH::collapseNode(uint32_t nodeIndex)
+{
+    // Keep opening the largest inner child until four are gathered
+    uint32_t children[4] = {nodes[nodeIndex].leftFirst, nodes[nodeIndex].leftFirst + 1};
+    uint32_t childCount = 2;
+    while (childCount < 4)
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < childCount; i++)
+        {
+            const BVHNode &child = nodes[children[i]];
+            float area = surfaceArea(child.boundsMin, child.boundsMax);
+            if (!child.isLeaf() && area > largestArea)
+            {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest < 0)
+            break;
+
+        uint32_t opened = children[largest];
+        children[largest] = nodes[opened].leftFirst;
+        children[childCount++] = nodes[opened].leftFirst + 1;
+    }
+
+    uint32_t wideIndex = wideNodes.size();
+    wideNodes.emplace_back();
+
+    BVH4Node wide;
+    wide.childCount = childCount;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        // Unused slots are masked out by childCount but kept inverted anyway
+        const bool used = i < childCount;
+        for (int a = 0; a < 3; a++)
+        {
+            wide.bounds[0][a][i] = used ? nodes[children[i]].boundsMin[a] : std::numeric_limits<float>::max();
+            wide.bounds[1][a][i] = used ? nodes[children[i]].boundsMax[a] : -std::numeric_limits<float>::max();
+        }
+        wide.children[i] = 0;
+        if (used)
+            wideSlots[children[i]] = 4 * wideIndex + i;
+    }
+
+    for (uint32_t i = 0; i < childCount; i++)
+        wide.children[i] = nodes[children[i]].isLeaf() ? (BVH4Node::leafFlag | children[i]) : collapseNode(children[i]);
+
+    wideNodes[wideIndex] = wide;
+    return wideIndex;
+}
+
+void BVH::linkNodes()
+{
+    parents.assign(nodes.size(), 0);
+    primitiveLeaves.assign(primitiveIndices.size(), 0);
+    for (uint32_t i = 0; i < nodes.size(); i++)
+    {
+        const BVHNode &node = nodes[i];
+        if (node.isLeaf())
+        {
+            for (uint32_t j = node.leftFirst; j < node.leftFirst + node.count; j++)
+                primitiveLeaves[primitiveIndices[j]] = i;
+        }
+        else
+        {
+            parents[node.leftFirst] = i;
+            parents[node.leftFirst + 1] = i;
+        }
+    }
+}
+
+// Returns false if the bounds were already equal
+bool BVH::setNodeBounds(uint32_t nodeIndex, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+    BVHNode &node = nodes[nodeIndex];
+    if (node.boundsMin == boundsMin && node.boundsMax == boundsMax)
+        return false;
+
+    float cost = node.isLeaf() ? leafCost(node.count) : traversalCost;
+    weightedArea += cost * (surfaceArea(boundsMin, boundsMax) - surfaceArea(node.boundsMin, node.boundsMax));
+    node.boundsMin = boundsMin;
+    node.boundsMax = boundsMax;
+
+    uint32_t slot = wideSlots[nodeIndex];
+    if (slot != noSlot)
+    {
+        BVH4Node &wide = wideNodes[slot / 4];
+        for (int a = 0; a < 3; a++)
+        {
+            wide.bounds[0][a][slot % 4] = boundsMin[a];
+            wide.bounds[1][a][slot % 4] = boundsMax[a];
+        }
+    }
+    return true;
+}
+
+float BVH::leafCost(uint32_t count) const
+{
+    return intersectionCost * ((count + leafBlockSize - 1) / leafBlockSize);
+}
+
+float BVH::surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+    glm::vec3 e = boundsMax - boundsMin;
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
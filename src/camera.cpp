@@ -1,4 +1,8 @@
+#include <cmath>
+
+#ifndef RAYZ_HEADLESS
 #include "jug/input.h"
+#endif
 
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/quaternion.hpp"
@@ -6,13 +10,21 @@
 
 #include "camera.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAYZ_CAMERA_SSE
+#include <emmintrin.h>
+#endif
+
+#ifndef RAYZ_HEADLESS
 using namespace Jug;
+#endif
 
 Camera::Camera(float verticalFOV, float nearClip, float farClip)
-    : projection(1.0f), view(1.0f), inverseProjection(1.0f), inverseView(1.0f), verticalFOV(verticalFOV), nearClip(nearClip), farClip(farClip), position(0.0f, 0.0f, 6.0f), forwardDirection(0.0f, 0.0f, -1.0f), lastMousePosition(0.0f, 0.0f), viewportHeight(0), viewportWidth(0)
+    : projection(1.0f), view(1.0f), inverseProjection(1.0f), inverseView(1.0f), verticalFOV(verticalFOV), nearClip(nearClip), farClip(farClip), position(0.0f, 0.0f, 6.0f), forwardDirection(0.0f, 0.0f, -1.0f), rayBase(0.0f), rayStepX(0.0f), rayStepY(0.0f), lastMousePosition(0.0f, 0.0f), viewportHeight(0), viewportWidth(0)
 {
 }
 
+#ifndef RAYZ_HEADLESS
 bool Camera::onUpdate(float ts)
 {
     glm::vec2 mousePos = Input::getMousePosition();
@@ -79,13 +91,11 @@ bool Camera::onUpdate(float ts)
     }
 
     if (moved)
-    {
         recalculateView();
-        recalculateRayDirections();
-    }
 
     return moved;
 }
+#endif
 
 void Camera::onResize(int width, int height)
 {
@@ -97,7 +107,6 @@ void Camera::onResize(int width, int height)
     viewportHeight = height;
 
     recalculateProjection();
-    recalculateRayDirections();
 }
 
 const glm::mat4 &Camera::getProjection() const
@@ -130,9 +139,49 @@ const glm::vec3 &Camera::getDirection() const
     return forwardDirection;
 }
 
-const std::vector<glm::vec3> &Camera::getRayDirections() const
+float Camera::getVerticalFOV() const
 {
-    return rayDirections;
+    return verticalFOV;
+}
+
+void Camera::generateRays(uint32_t x, uint32_t y, uint32_t count, const glm::vec2 *jitter, glm::vec3 *directions) const
+{
+    uint32_t i = 0;
+#ifdef RAYZ_CAMERA_SSE
+    const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)(x + i)), laneOffsets);
+        __m128 py = _mm_set1_ps((float)y);
+        if (jitter)
+        {
+            px = _mm_add_ps(px, _mm_set_ps(jitter[i + 3].x, jitter[i + 2].x, jitter[i + 1].x, jitter[i].x));
+            py = _mm_add_ps(py, _mm_set_ps(jitter[i + 3].y, jitter[i + 2].y, jitter[i + 1].y, jitter[i].y));
+        }
+
+        __m128 d[3];
+        for (int a = 0; a < 3; a++)
+            d[a] = _mm_add_ps(_mm_add_ps(_mm_set1_ps(rayBase[a]), _mm_mul_ps(px, _mm_set1_ps(rayStepX[a]))),
+                              _mm_mul_ps(py, _mm_set1_ps(rayStepY[a])));
+
+        __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2]));
+        __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+        float lanes[3][4];
+        for (int a = 0; a < 3; a++)
+            _mm_storeu_ps(lanes[a], _mm_mul_ps(d[a], invLength));
+        for (uint32_t lane = 0; lane < 4; lane++)
+            directions[i + lane] = glm::vec3(lanes[0][lane], lanes[1][lane], lanes[2][lane]);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float px = (float)(x + i) + (jitter ? jitter[i].x : 0.0f);
+        float py = (float)y + (jitter ? jitter[i].y : 0.0f);
+        glm::vec3 d = rayBase + px * rayStepX + py * rayStepY;
+        directions[i] = d * (1.0f / std::sqrt(glm::dot(d, d)));
+    }
 }
 
 float Camera::getRotationSpeed()
@@ -144,27 +193,34 @@ void Camera::recalculateProjection()
 {
     projection = glm::perspectiveFov(glm::radians(verticalFOV), (float)viewportWidth, (float)viewportHeight, nearClip, farClip);
     inverseProjection = glm::inverse(projection);
+    recalculateRayBasis();
 }
 
 void Camera::recalculateView()
 {
     view = glm::lookAt(position, position + forwardDirection, glm::vec3(0, 1, 0));
     inverseView = glm::inverse(view);
+    recalculateRayBasis();
 }
 
-void Camera::recalculateRayDirections()
+void Camera::recalculateRayBasis()
 {
-    rayDirections.resize(viewportWidth * viewportHeight);
-    for (int y = 0; y < viewportHeight; y++)
-    {
-        for (int x = 0; x < viewportWidth; x++)
-        {
-            glm::vec2 coord = {(float)x / (float)viewportWidth, (float)y / (float)viewportHeight};
-            coord = coord * 2.0f - 1.0f; // -1 -> 1
+    if (viewportWidth == 0 || viewportHeight == 0)
+        return;
 
-            glm::vec4 target = inverseProjection * glm::vec4(coord.x, coord.y, 1, 1);
-            glm::vec3 rayDirection = glm::vec3(inverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0)); // World space
-            rayDirections[x + y * viewportWidth] = rayDirection;
-        }
-    }
+    // The view space target is affine in NDC for a perspective projection,
+    // and the view rotation keeps lengths, so three corners give the basis
+    auto viewTarget = [this](float x, float y)
+    {
+        glm::vec4 target = inverseProjection * glm::vec4(x, y, 1, 1);
+        return glm::vec3(target) / target.w;
+    };
+    glm::vec3 corner = viewTarget(-1.0f, -1.0f);
+    glm::vec3 right = viewTarget(1.0f, -1.0f) - corner;
+    glm::vec3 up = viewTarget(-1.0f, 1.0f) - corner;
+
+    glm::mat3 rotation(inverseView);
+    rayBase = rotation * corner;
+    rayStepX = rotation * right / (float)viewportWidth;
+    rayStepY = rotation * up / (float)viewportHeight;
 }
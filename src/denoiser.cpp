@@ -0,0 +1,215 @@
+#include <chrono>
+
+#include "denoiser.h"
+
+namespace
+{
+    // Rows handed to a worker at once
+    const uint32_t rowGrain = 8;
+
+    // B3 spline, separable
+    const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+    // 3x3 Gaussian smoothing the variance before it sets the colour sigma
+    const float varianceKernel[3] = {0.25f, 0.5f, 0.25f};
+
+    // One over the length of each tap offset, depth edges are judged per
+    // pixel moved rather than per tap
+    const float inverseTapDistance[5][5] = {
+        {0.3536f, 0.4472f, 0.5f, 0.4472f, 0.3536f},
+        {0.4472f, 0.7071f, 1.0f, 0.7071f, 0.4472f},
+        {0.5f, 1.0f, 0.0f, 1.0f, 0.5f},
+        {0.4472f, 0.7071f, 1.0f, 0.7071f, 0.4472f},
+        {0.3536f, 0.4472f, 0.5f, 0.4472f, 0.3536f}};
+
+    // Rec. 709 luma
+    const glm::vec3 luminanceWeights(0.2126f, 0.7152f, 0.0722f);
+
+    template <typename Job>
+    void forEachRow(TileScheduler &scheduler, uint32_t height, Job &&job)
+    {
+#ifdef MT
+        scheduler.parallelFor(height, rowGrain, [&job](uint32_t begin, uint32_t end, uint32_t worker)
+                              {
+                                  for (uint32_t y = begin; y < end; y++)
+                                      job(y); });
+#else
+        for (uint32_t y = 0; y < height; y++)
+            job(y);
+#endif
+    }
+
+    // Black albedo would blow the division up, leave those pixels as they are
+    glm::vec3 safeAlbedo(const glm::vec3 &albedo)
+    {
+        glm::vec3 safe = albedo;
+        for (int c = 0; c < 3; c++)
+            if (safe[c] < 1e-3f)
+                safe[c] = 1.0f;
+        return safe;
+    }
+}
+
+void Denoiser::denoise(const glm::vec3 *radianceSums, const uint32_t *sampleCounts, const float *squaredLuminance, const PixelFeatures *features,
+                       uint32_t width, uint32_t height, TileScheduler &scheduler)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    this->width = width;
+    this->height = height;
+    const size_t pixelCount = (size_t)width * height;
+    irradiance.resize(pixelCount);
+    filtered.resize(pixelCount);
+    guides.resize(pixelCount);
+    albedos.resize(pixelCount);
+    depthGradients.resize(pixelCount);
+    output.resize(pixelCount);
+
+    prepare(radianceSums, sampleCounts, squaredLuminance, features, scheduler);
+    for (int i = 0; i < settings.iterations; i++)
+    {
+        filterPass(1 << i, scheduler);
+        irradiance.swap(filtered);
+    }
+
+    forEachRow(scheduler, height, [this](uint32_t y)
+               {
+                   for (uint32_t i = y * this->width; i < (y + 1) * this->width; i++)
+                       output[i] = glm::vec3(irradiance[i]) * albedos[i]; });
+
+    stats.denoiseTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const glm::vec3 *Denoiser::getOutput() const
+{
+    return output.data();
+}
+
+Denoiser::Settings &Denoiser::getSettings()
+{
+    return settings;
+}
+
+const Denoiser::Stats &Denoiser::getStats() const
+{
+    return stats;
+}
+
+void Denoiser::prepare(const glm::vec3 *radianceSums, const uint32_t *sampleCounts, const float *squaredLuminance, const PixelFeatures *features,
+                       TileScheduler &scheduler)
+{
+    forEachRow(scheduler, height, [&](uint32_t y)
+               {
+                   for (uint32_t i = y * width; i < (y + 1) * width; i++)
+                   {
+                       float n = glm::max((float)sampleCounts[i], 1.0f);
+                       glm::vec3 color = radianceSums[i] / n;
+                       glm::vec3 albedo = safeAlbedo(features[i].albedo / n);
+                       glm::vec3 normal = features[i].normal / n;
+                       float normalLength = glm::length(normal);
+
+                       // Variance of the mean, unknown below two samples
+                       float mean = glm::dot(color, luminanceWeights);
+                       float variance = 1.0f;
+                       if (n >= 2.0f)
+                           variance = glm::max(0.0f, squaredLuminance[i] / n - mean * mean) / (n - 1.0f);
+                       float albedoLuminance = glm::dot(albedo, luminanceWeights);
+
+                       irradiance[i] = glm::vec4(color / albedo, variance / (albedoLuminance * albedoLuminance));
+                       guides[i] = glm::vec4(normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f), features[i].depth / n);
+                       albedos[i] = albedo;
+                   }
+               });
+
+    // Central differences need every depth first
+    forEachRow(scheduler, height, [this](uint32_t y)
+               {
+                   for (uint32_t x = 0; x < width; x++)
+                   {
+                       float left = guides[y * width + (x > 0 ? x - 1 : x)].w;
+                       float right = guides[y * width + (x + 1 < width ? x + 1 : x)].w;
+                       float up = guides[(y > 0 ? y - 1 : y) * width + x].w;
+                       float down = guides[(y + 1 < height ? y + 1 : y) * width + x].w;
+                       depthGradients[y * width + x] = 0.5f * glm::max(glm::abs(right - left), glm::abs(down - up));
+                   } });
+}
+
+void Denoiser::filterPass(int step, TileScheduler &scheduler)
+{
+    forEachRow(scheduler, height, [this, step](uint32_t y)
+               { filterRow(y, step); });
+}
+
+float Denoiser::smoothedVariance(uint32_t x, uint32_t y) const
+{
+    float sum = 0.0f, weightSum = 0.0f;
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        int qy = (int)y + dy;
+        if (qy < 0 || qy >= (int)height)
+            continue;
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            int qx = (int)x + dx;
+            if (qx < 0 || qx >= (int)width)
+                continue;
+            float weight = varianceKernel[dx + 1] * varianceKernel[dy + 1];
+            sum += weight * irradiance[qy * width + qx].w;
+            weightSum += weight;
+        }
+    }
+    return sum / weightSum;
+}
+
+void Denoiser::filterRow(uint32_t y, int step)
+{
+
+    for (uint32_t x = 0; x < width; x++)
+    {
+        const uint32_t center = y * width + x;
+        const glm::vec4 &centerColor = irradiance[center];
+        const glm::vec4 &centerGuide = guides[center];
+        const float centerLuminance = glm::dot(glm::vec3(centerColor), luminanceWeights);
+        const float luminanceScale = 1.0f / (settings.colorSigma * glm::sqrt(smoothedVariance(x, y)) + 1e-4f);
+        const float depthScale = 1.0f / (settings.depthSigma * depthGradients[center] * step + 1e-3f);
+
+        float centerWeight = kernel[2] * kernel[2];
+        glm::vec3 colorSum = centerWeight * glm::vec3(centerColor);
+        float varianceSum = centerWeight * centerWeight * centerColor.w;
+        float weightSum = centerWeight;
+
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            int qy = (int)y + dy * step;
+            if (qy < 0 || qy >= (int)height)
+                continue;
+
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                int qx = (int)x + dx * step;
+                if ((dx == 0 && dy == 0) || qx < 0 || qx >= (int)width)
+                    continue;
+
+                const uint32_t tap = qy * width + qx;
+                const glm::vec4 &color = irradiance[tap];
+                const glm::vec4 &guide = guides[tap];
+
+                // cos^128 by squaring, misses (zero normals) match nothing
+                float normalWeight = glm::max(glm::dot(glm::vec3(centerGuide), glm::vec3(guide)), 0.0f);
+                for (int i = 0; i < 7; i++)
+                    normalWeight *= normalWeight;
+                if (normalWeight < 1e-4f)
+                    continue;
+
+                float depthDistance = glm::abs(centerGuide.w - guide.w) * depthScale * inverseTapDistance[dy + 2][dx + 2];
+                float luminanceDistance = glm::abs(centerLuminance - glm::dot(glm::vec3(color), luminanceWeights)) * luminanceScale;
+                float weight = kernel[dx + 2] * kernel[dy + 2] * normalWeight * glm::exp(-depthDistance - luminanceDistance);
+
+                colorSum += weight * glm::vec3(color);
+                varianceSum += weight * weight * color.w;
+                weightSum += weight;
+            }
+        }
+
+        filtered[center] = glm::vec4(colorSum / weightSum, varianceSum / (weightSum * weightSum));
+    }
+}
@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "emitters.h"
+
+void EmitterList::clear()
+{
+    emitters.clear();
+    cumulativeAreas.clear();
+    objects.clear();
+    totalArea = 0.0f;
+}
+
+void EmitterList::add(const Hittable *object, uint32_t materialId)
+{
+    size_t firstEmitter = emitters.size();
+    uint32_t count = object->getSampleablePrimitiveCount();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float area = object->getPrimitiveArea(i);
+        if (area <= 0.0f)
+            continue;
+
+        totalArea += area;
+        emitters.push_back({object, i, materialId});
+        cumulativeAreas.push_back(totalArea);
+    }
+
+    if (emitters.size() > firstEmitter)
+        objects.push_back(object);
+}
+
+bool EmitterList::empty() const
+{
+    return emitters.empty();
+}
+
+uint32_t EmitterList::getPrimitiveCount() const
+{
+    return emitters.size();
+}
+
+bool EmitterList::contains(const Hittable *object) const
+{
+    // A handful of emissive objects, a linear search beats hashing
+    return std::find(objects.begin(), objects.end(), object) != objects.end();
+}
+
+void EmitterList::sample(Sampler &sampler, Sample &sample) const
+{
+    float target = sampler.nextFloat() * totalArea;
+    size_t index = std::upper_bound(cumulativeAreas.begin(), cumulativeAreas.end(), target) - cumulativeAreas.begin();
+    const Emitter &emitter = emitters[std::min(index, emitters.size() - 1)];
+
+    emitter.object->samplePrimitive(emitter.primitiveId, sampler.next2D(), sample.position, sample.normal, sample.uv);
+    sample.materialId = emitter.materialId;
+}
+
+float EmitterList::getAreaPdf() const
+{
+    return totalArea > 0.0f ? 1.0f / totalArea : 0.0f;
+}
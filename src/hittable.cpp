@@ -3,10 +3,58 @@
 #include "glm/gtc/constants.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "hittable.h"
 
 Hittable::Hittable(const std::string &name)
     : name(name)
 {
 }
+
+bool Hittable::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+{
+    Intersection intersection;
+    if (!intersect(ray, tMin, tMax, intersection))
+        return false;
+
+    intersection.object->computeSurfaceInteraction(ray, intersection, payload);
+    payload.object = intersection.object;
+    return true;
+}
+
+bool Hittable::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    Intersection intersection;
+    return intersect(ray, tMin, tMax, intersection);
+}
+
+uint64_t Hittable::intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const
+{
+    uint64_t hitMask = 0;
+    for (uint32_t i = firstActive; i < packet.count; i++)
+    {
+        if (intersect(packet.getRay(i), tMin, packet.tMax[i], intersections[i]))
+        {
+            packet.tMax[i] = intersections[i].t;
+            hitMask |= 1ull << i;
+        }
+    }
+    return hitMask;
+}
+
+uint64_t Hittable::hitPacket(RayPacket &packet, float tMin, HitPayload *payloads) const
+{
+    Intersection intersections[RayPacket::size];
+    uint64_t hitMask = intersectPacket(packet, 0, tMin, intersections);
+
+    for (uint32_t i = 0; i < packet.count; i++)
+        if (hitMask & (1ull << i))
+        {
+            intersections[i].object->computeSurfaceInteraction(packet.getRay(i), intersections[i], payloads[i]);
+            payloads[i].object = intersections[i].object;
+        }
+
+    return hitMask;
+}
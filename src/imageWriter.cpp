@@ -0,0 +1,213 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef RAYZ_HEADLESS
+// The viewer gets these from jug, the headless build has to compile them itself
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#endif
+#include "stb/stb_image.h"
+#include "stb/stb_image_write.h"
+#include "imageWriter.h"
+
+namespace
+{
+    // OpenEXR pixel type and compression codes
+    const int32_t exrFloat = 2;
+    const uint8_t exrRLE = 1;
+    // Longest run one RLE code covers
+    const int rleMaxRun = 127;
+
+    void putBytes(std::vector<uint8_t> &out, uint32_t value, int count)
+    {
+        for (int i = 0; i < count; i++)
+            out.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    void putFloat(std::vector<uint8_t> &out, float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        putBytes(out, bits, 4);
+    }
+
+    void putAttribute(std::vector<uint8_t> &out, const char *name, const char *type, const std::vector<uint8_t> &value)
+    {
+        out.insert(out.end(), name, name + std::strlen(name) + 1);
+        out.insert(out.end(), type, type + std::strlen(type) + 1);
+        putBytes(out, value.size(), 4);
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    // Byte oriented RLE as OpenEXR's RleCompressor does it: the bytes are
+    // split into even and odd halves and delta coded first, so the high
+    // bytes of similar floats turn into long runs
+    void compressRLE(std::vector<uint8_t> &line, std::vector<uint8_t> &split, std::vector<uint8_t> &out)
+    {
+        const size_t size = line.size();
+        split.resize(size);
+        for (size_t i = 0; i < size; i++)
+            split[(i & 1) ? (size + 1) / 2 + i / 2 : i / 2] = line[i];
+        for (size_t i = size - 1; i > 0; i--)
+            split[i] = (uint8_t)(split[i] - split[i - 1] + 128);
+
+        out.clear();
+        size_t runStart = 0;
+        while (runStart < size)
+        {
+            size_t runEnd = runStart + 1;
+            while (runEnd < size && split[runEnd] == split[runStart] && runEnd - runStart <= rleMaxRun)
+                runEnd++;
+
+            if (runEnd - runStart >= 3)
+            {
+                // Repeated byte, stored as count - 1 and the byte
+                out.push_back((uint8_t)(runEnd - runStart - 1));
+                out.push_back(split[runStart]);
+            }
+            else
+            {
+                // Literal bytes up to the next run of three, stored as -count
+                while (runEnd < size && runEnd - runStart < rleMaxRun &&
+                       (runEnd + 2 >= size || split[runEnd] != split[runEnd + 1] || split[runEnd + 1] != split[runEnd + 2]))
+                    runEnd++;
+                out.push_back((uint8_t)-(int)(runEnd - runStart));
+                out.insert(out.end(), split.begin() + runStart, split.begin() + runEnd);
+            }
+            runStart = runEnd;
+        }
+    }
+}
+
+bool ImageWriter::writePNG(const std::string &filePath, uint32_t width, uint32_t height, const uint32_t *data)
+{
+    if (!data || width == 0 || height == 0)
+        return false;
+
+    // Rows are stored bottom-up for the GL texture, walk them backwards
+    int stride = width * sizeof(uint32_t);
+    const uint32_t *lastRow = data + (size_t)(height - 1) * width;
+    return stbi_write_png(filePath.c_str(), width, height, 4, lastRow, -stride) != 0;
+}
+
+bool ImageWriter::writePFM(const std::string &filePath, uint32_t width, uint32_t height, uint32_t channels, const FloatRowSource &rows)
+{
+    if (width == 0 || height == 0 || (channels != 1 && channels != 3))
+        return false;
+
+    FILE *file = std::fopen(filePath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    // Floats are written as they are in memory, a negative scale marks
+    // them little endian
+    const uint16_t probe = 1;
+    const bool littleEndian = *(const uint8_t *)&probe == 1;
+    std::fprintf(file, "%s\n%u %u\n%s\n", channels == 3 ? "PF" : "Pf", width, height, littleEndian ? "-1.0" : "1.0");
+
+    // PFM stores its rows bottom-up as well
+    std::vector<float> row(width * channels);
+    bool written = true;
+    for (uint32_t y = 0; y < height && written; y++)
+    {
+        rows(y, row.data());
+        written = std::fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+    }
+
+    return std::fclose(file) == 0 && written;
+}
+
+bool ImageWriter::writeEXR(const std::string &filePath, uint32_t width, uint32_t height, uint32_t channels, const FloatRowSource &rows)
+{
+    if (width == 0 || height == 0 || (channels != 1 && channels != 3))
+        return false;
+
+    FILE *file = std::fopen(filePath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    // Channels are listed alphabetically, rows interleave them as R, G, B
+    static const char *rgbNames[3] = {"B", "G", "R"};
+    static const uint32_t rgbOffsets[3] = {2, 1, 0};
+    static const char *greyNames[1] = {"Y"};
+    static const uint32_t greyOffsets[1] = {0};
+    const char **names = channels == 3 ? rgbNames : greyNames;
+    const uint32_t *offsets = channels == 3 ? rgbOffsets : greyOffsets;
+
+    std::vector<uint8_t> header, value;
+    putBytes(header, 20000630, 4);
+    // Version 2, single part scanline
+    putBytes(header, 2, 4);
+
+    for (uint32_t c = 0; c < channels; c++)
+    {
+        value.insert(value.end(), names[c], names[c] + 2);
+        putBytes(value, exrFloat, 4);
+        // Not perceptually linear, 3 reserved bytes, no subsampling
+        putBytes(value, 0, 4);
+        putBytes(value, 1, 4);
+        putBytes(value, 1, 4);
+    }
+    value.push_back(0);
+    putAttribute(header, "channels", "chlist", value);
+    putAttribute(header, "compression", "compression", {exrRLE});
+
+    value.clear();
+    putBytes(value, 0, 4);
+    putBytes(value, 0, 4);
+    putBytes(value, width - 1, 4);
+    putBytes(value, height - 1, 4);
+    putAttribute(header, "dataWindow", "box2i", value);
+    putAttribute(header, "displayWindow", "box2i", value);
+    // Increasing y, top row first
+    putAttribute(header, "lineOrder", "lineOrder", {0});
+
+    value.clear();
+    putFloat(value, 1.0f);
+    putAttribute(header, "pixelAspectRatio", "float", value);
+    putAttribute(header, "screenWindowWidth", "float", value);
+    value.clear();
+    putFloat(value, 0.0f);
+    putFloat(value, 0.0f);
+    putAttribute(header, "screenWindowCenter", "v2f", value);
+    header.push_back(0);
+
+    // Chunk offsets are only known once each line is compressed, the table
+    // is reserved here and filled in at the end
+    std::vector<uint8_t> offsetTable(height * sizeof(uint64_t), 0);
+    bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+                   std::fwrite(offsetTable.data(), 1, offsetTable.size(), file) == offsetTable.size();
+
+    uint64_t position = header.size() + offsetTable.size();
+    std::vector<float> row(width * channels);
+    std::vector<uint8_t> line, split, compressed, chunk;
+    for (uint32_t lineIndex = 0; lineIndex < height && written; lineIndex++)
+    {
+        rows(height - 1 - lineIndex, row.data());
+
+        // One channel after another within the line
+        line.clear();
+        for (uint32_t c = 0; c < channels; c++)
+            for (uint32_t x = 0; x < width; x++)
+                putFloat(line, row[x * channels + offsets[c]]);
+
+        // Lines that do not shrink are stored raw, readers tell by the size
+        compressRLE(line, split, compressed);
+        const std::vector<uint8_t> &data = compressed.size() < line.size() ? compressed : line;
+
+        chunk.clear();
+        putBytes(chunk, lineIndex, 4);
+        putBytes(chunk, data.size(), 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        written = std::fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+
+        for (int i = 0; i < 8; i++)
+            offsetTable[lineIndex * 8 + i] = (position >> (8 * i)) & 0xff;
+        position += chunk.size();
+    }
+
+    written = written && std::fseek(file, (long)header.size(), SEEK_SET) == 0 &&
+              std::fwrite(offsetTable.data(), 1, offsetTable.size(), file) == offsetTable.size();
+    return std::fclose(file) == 0 && written;
+}
@@ -1,5 +1,6 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
-#include "glm/gtc/random.hpp"
+#endif
 #include "materials/dielectric.h"
 
 Dieletric::Dieletric(const glm::vec3 &albedo, float index_of_refraction)
@@ -12,26 +13,36 @@ Dieletric::Dieletric(const std::shared_ptr<Texture> &texture, float index_of_ref
 {
 }
 
-bool Dieletric::scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const
+bool Dieletric::sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const
 {
-    attenuation = texture->value(payload.u, payload.v, payload.worldPosition);
+    sample.weight = texture->value(payload.u, payload.v, payload.worldPosition);
+    sample.pdf = 0.0f;
     float ratio = payload.frontFace ? (1.0 / ir) : ir;
 
-    glm::vec3 normalized = glm::normalize(ray.direction);
-    double cos = glm::min(glm::dot(-normalized, payload.worldNormal), 1.0f);
+    double cos = glm::min(glm::dot(wo, payload.worldNormal), 1.0f);
     double sin = sqrt(1.0 - cos * cos);
 
     bool cannotRefract = (ratio * sin) > 1.0;
 
-    if (cannotRefract || (reflectance(cos, ratio) > glm::linearRand(0.0f, 1.0f)))
-        scattered.direction = glm::reflect(normalized, payload.worldNormal);
+    if (cannotRefract || (reflectance(cos, ratio) > sampler.nextFloat()))
+        sample.direction = glm::reflect(-wo, payload.worldNormal);
     else
-        scattered.direction = glm::refract(normalized, payload.worldNormal, ratio);
+        sample.direction = glm::refract(-wo, payload.worldNormal, ratio);
 
-    scattered.origin = payload.worldPosition;
     return true;
 }
 
+glm::vec3 Dieletric::albedo(const HitPayload &payload) const
+{
+    return texture->value(payload.u, payload.v, payload.worldPosition);
+}
+
+MaterialType Dieletric::getType() const
+{
+    return MaterialType::DIELECTRIC;
+}
+
+#ifndef RAYZ_HEADLESS
 bool Dieletric::renderUI()
 {
     bool moved = false;
@@ -45,6 +56,7 @@ bool Dieletric::renderUI()
         moved = true;
     return moved;
 }
+#endif
 
 glm::vec3 Dieletric::refract(const glm::vec3 &uv, const glm::vec3 &n, float etai_over_etat)
 {
@@ -10,7 +10,12 @@ DiffuseLight::DiffuseLight(const std::shared_ptr<Texture> &texture)
 {
 }
 
-bool DiffuseLight::scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const
+bool DiffuseLight::isEmissive() const
+{
+    return true;
+}
+
+bool DiffuseLight::sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const
 {
     return false;
 }
@@ -23,6 +28,17 @@ glm::vec3 DiffuseLight::emitted(const Ray &ray, const HitPayload &payload, doubl
         return glm::vec3(0.0f);
 }
 
+glm::vec3 DiffuseLight::albedo(const HitPayload &payload) const
+{
+    return texture->value(payload.u, payload.v, payload.worldPosition);
+}
+
+MaterialType DiffuseLight::getType() const
+{
+    return MaterialType::DIFFUSE_LIGHT;
+}
+
+#ifndef RAYZ_HEADLESS
 bool DiffuseLight::renderUI()
 {
     bool moved = false;
@@ -30,3 +46,4 @@ bool DiffuseLight::renderUI()
         moved = true;
     return moved;
 }
+#endif
@@ -1,4 +1,4 @@
-#include "glm/gtc/random.hpp"
+#include "glm/gtc/constants.hpp"
 #include "materials/lambertian.h"
 
 Lambertian::Lambertian(const glm::vec3 &albedo)
@@ -11,15 +11,39 @@ Lambertian::Lambertian(const std::shared_ptr<Texture> &texture)
 {
 }
 
-bool Lambertian::scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const
+bool Lambertian::sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const
 {
-    glm::vec3 scatterDirection = payload.worldNormal + glm::normalize(glm::linearRand(glm::vec3(-1.0f), glm::vec3(1.0f)));
-    scattered.origin = payload.worldPosition;
-    scattered.direction = scatterDirection;
-    attenuation = texture->value(payload.u, payload.v, payload.worldPosition);
-    return true;
+    // Cosine weighted, so the cosine and 1 / pi cancel against the pdf
+    sample.direction = sampler.powerCosineDirection(payload.worldNormal, 1.0f);
+    sample.pdf = glm::max(glm::dot(payload.worldNormal, sample.direction), 0.0f) / glm::pi<float>();
+    sample.weight = texture->value(payload.u, payload.v, payload.worldPosition);
+    return sample.pdf > 0.0f;
 }
 
+glm::vec3 Lambertian::eval(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const
+{
+    float cosine = glm::dot(payload.worldNormal, wi);
+    if (cosine <= 0.0f)
+        return glm::vec3(0.0f);
+    return texture->value(payload.u, payload.v, payload.worldPosition) * (cosine / glm::pi<float>());
+}
+
+float Lambertian::pdf(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const
+{
+    return glm::max(glm::dot(payload.worldNormal, wi), 0.0f) / glm::pi<float>();
+}
+
+glm::vec3 Lambertian::albedo(const HitPayload &payload) const
+{
+    return texture->value(payload.u, payload.v, payload.worldPosition);
+}
+
+MaterialType Lambertian::getType() const
+{
+    return MaterialType::LAMBERTIAN;
+}
+
+#ifndef RAYZ_HEADLESS
 bool Lambertian::renderUI()
 {
     bool moved = false;
@@ -29,3 +53,4 @@ bool Lambertian::renderUI()
 
     return moved;
 }
+#endif
@@ -1,5 +1,7 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
-#include "glm/gtc/random.hpp"
+#endif
+#include "glm/gtc/constants.hpp"
 #include "materials/metal.h"
 
 Metal::Metal(const glm::vec3 &albedo, float fuzz)
@@ -8,23 +10,78 @@ Metal::Metal(const glm::vec3 &albedo, float fuzz)
 }
 
 Metal::Metal(const std::shared_ptr<Texture> &texture, float fuzz)
-    : texture(texture), fuzz(fuzz)
+    : texture(texture), fuzz(glm::clamp(fuzz, 0.0f, 1.0f))
 {
 }
 
-bool Metal::scatter(const Ray &ray, const HitPayload &payload, glm::vec3 &attenuation, Ray &scattered) const
+// Normalised Phong lobe around the mirror direction r:
+//   f = albedo (n + 2) / 2pi cos^n(wi, r), pdf = (n + 1) / 2pi cos^n(wi, r)
+bool Metal::sample(const HitPayload &payload, const glm::vec3 &wo, Sampler &sampler, BSDFSample &sample) const
 {
-    glm::vec3 scatteredDirection = glm::reflect(ray.direction, payload.worldNormal);
-    scattered.origin = payload.worldPosition;
-    scattered.direction = scatteredDirection + fuzz * glm::normalize(glm::linearRand(glm::vec3(-1.0f), glm::vec3(1.0f)));
-    attenuation = texture->value(payload.u, payload.v, payload.worldPosition);
-    return dot(scatteredDirection, payload.worldNormal) > 0;
+    glm::vec3 albedo = texture->value(payload.u, payload.v, payload.worldPosition);
+    glm::vec3 mirror = glm::reflect(-wo, payload.worldNormal);
+    if (fuzz <= minFuzz)
+    {
+        sample.direction = mirror;
+        sample.weight = albedo;
+        sample.pdf = 0.0f;
+        return true;
+    }
+
+    float exponent = getExponent();
+    sample.direction = sampler.powerCosineDirection(mirror, exponent);
+    float cosine = glm::dot(sample.direction, payload.worldNormal);
+    if (cosine <= 0.0f)
+        return false;
+
+    sample.weight = albedo * ((exponent + 2.0f) / (exponent + 1.0f) * cosine);
+    sample.pdf = pdf(payload, wo, sample.direction);
+    return true;
+}
+
+glm::vec3 Metal::eval(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const
+{
+    float cosine = glm::dot(wi, payload.worldNormal);
+    if (fuzz <= minFuzz || cosine <= 0.0f)
+        return glm::vec3(0.0f);
+
+    float exponent = getExponent();
+    float lobe = glm::max(glm::dot(wi, glm::reflect(-wo, payload.worldNormal)), 0.0f);
+    return texture->value(payload.u, payload.v, payload.worldPosition) *
+           ((exponent + 2.0f) / (2.0f * glm::pi<float>()) * glm::pow(lobe, exponent) * cosine);
+}
+
+float Metal::pdf(const HitPayload &payload, const glm::vec3 &wo, const glm::vec3 &wi) const
+{
+    if (fuzz <= minFuzz || glm::dot(wi, payload.worldNormal) <= 0.0f)
+        return 0.0f;
+
+    float exponent = getExponent();
+    float lobe = glm::max(glm::dot(wi, glm::reflect(-wo, payload.worldNormal)), 0.0f);
+    return (exponent + 1.0f) / (2.0f * glm::pi<float>()) * glm::pow(lobe, exponent);
+}
+
+float Metal::getExponent() const
+{
+    // Matches a Beckmann lobe of roughness fuzz, fuzz 1 is uniform around r
+    return 2.0f / (fuzz * fuzz) - 2.0f;
+}
+
+glm::vec3 Metal::albedo(const HitPayload &payload) const
+{
+    return texture->value(payload.u, payload.v, payload.worldPosition);
+}
+
+MaterialType Metal::getType() const
+{
+    return MaterialType::METAL;
 }
 
+#ifndef RAYZ_HEADLESS
 bool Metal::renderUI()
 {
     bool moved = false;
-    if (ImGui::DragFloat("##", &fuzz, 0.001f))
+    if (ImGui::DragFloat("##", &fuzz, 0.001f, 0.0f, 1.0f))
         moved = true;
     if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
     {
@@ -34,3 +91,4 @@ bool Metal::renderUI()
         moved = true;
     return moved;
 }
+#endif
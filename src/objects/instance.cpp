@@ -0,0 +1,145 @@
+#include <limits>
+
+#ifndef RAYZ_HEADLESS
+#include "imgui.h"
+#endif
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "objects/instance.h"
+
+Instance::Instance(const std::string &name, std::shared_ptr<const Hittable> object, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale)
+    : Hittable(name), position(position), rotation(rotation), scale(scale), object(std::move(object))
+{
+    updateTransform();
+}
+
+void Instance::updateTransform()
+{
+    objectToWorld = glm::translate(glm::mat4(1.0f), position);
+    objectToWorld = glm::rotate(objectToWorld, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    objectToWorld = glm::rotate(objectToWorld, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    objectToWorld = glm::rotate(objectToWorld, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    objectToWorld = glm::scale(objectToWorld, scale);
+
+    glm::mat4 worldToObject = glm::inverse(objectToWorld);
+    worldToObjectLinear = glm::mat3(worldToObject);
+    worldToObjectTranslation = glm::vec3(worldToObject[3]);
+    normalToWorld = glm::transpose(worldToObjectLinear);
+}
+
+const std::shared_ptr<const Hittable> &Instance::getObject() const
+{
+    return object;
+}
+
+Ray Instance::toObject(const Ray &ray) const
+{
+    return {worldToObjectLinear * ray.origin + worldToObjectTranslation, worldToObjectLinear * ray.direction};
+}
+
+bool Instance::intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const
+{
+    if (!object->intersect(toObject(ray), tMin, tMax, intersection))
+        return false;
+
+    intersection.instanceObject = intersection.object;
+    intersection.object = this;
+    return true;
+}
+
+void Instance::computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const
+{
+    Intersection local = intersection;
+    local.object = intersection.instanceObject;
+    local.object->computeSurfaceInteraction(toObject(ray), local, payload);
+
+    // frontFace is invariant under the transform, only the vectors move
+    payload.worldPosition = ray.origin + intersection.t * ray.direction;
+    payload.worldNormal = glm::normalize(normalToWorld * payload.worldNormal);
+    payload.geometricNormal = glm::normalize(normalToWorld * payload.geometricNormal);
+}
+
+bool Instance::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    return object->occluded(toObject(ray), tMin, tMax);
+}
+
+uint64_t Instance::intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const
+{
+    // The shared origin maps to a single point, so the rays stay a packet
+    RayPacket localPacket;
+    localPacket.origin = worldToObjectLinear * packet.origin + worldToObjectTranslation;
+    // Rays before firstActive are carried along so the indices line up
+    for (uint32_t i = 0; i < packet.count; i++)
+    {
+        localPacket.add(worldToObjectLinear * packet.directions[i]);
+        localPacket.tMax[i] = packet.tMax[i];
+    }
+    localPacket.finalize();
+
+    uint64_t hitMask = object->intersectPacket(localPacket, firstActive, tMin, intersections);
+    for (uint32_t i = firstActive; i < packet.count; i++)
+    {
+        if (!(hitMask & (1ull << i)))
+            continue;
+
+        packet.tMax[i] = localPacket.tMax[i];
+        intersections[i].instanceObject = intersections[i].object;
+        intersections[i].object = this;
+    }
+    return hitMask;
+}
+
+bool Instance::boundingBox(AABB &outputBox) const
+{
+    AABB box;
+    if (!object->boundingBox(box))
+        return false;
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 p((corner & 1) ? box.getMax().x : box.getMin().x,
+                    (corner & 2) ? box.getMax().y : box.getMin().y,
+                    (corner & 4) ? box.getMax().z : box.getMin().z);
+        glm::vec3 world = glm::vec3(objectToWorld * glm::vec4(p, 1.0f));
+        boundsMin = glm::min(boundsMin, world);
+        boundsMax = glm::max(boundsMax, world);
+    }
+
+    outputBox = AABB(boundsMin, boundsMax);
+    return true;
+}
+
+bool Instance::material(uint32_t &outputId) const
+{
+    return object->material(outputId);
+}
+
+#ifndef RAYZ_HEADLESS
+bool Instance::renderUI()
+{
+    bool moved = false;
+    {
+        ImGui::SeparatorText("Props");
+        ImGui::Text("Instance of %s", object->name.c_str());
+        if (ImGui::DragFloat3("###Position", glm::value_ptr(position), 0.01f))
+            moved = true;
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+            ImGui::SetTooltip("Position");
+        if (ImGui::DragFloat3("###Rotation", glm::value_ptr(rotation), 0.5f))
+            moved = true;
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+            ImGui::SetTooltip("Rotation");
+        if (ImGui::DragFloat3("###Scale", glm::value_ptr(scale), 0.01f))
+            moved = true;
+        if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+            ImGui::SetTooltip("Scale");
+    }
+
+    if (moved)
+        updateTransform();
+    return moved;
+}
+#endif
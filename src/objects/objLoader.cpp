@@ -0,0 +1,161 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include "objects/triangleMesh.h"
+
+namespace
+{
+    struct VertexKey
+    {
+        int position, uv, normal;
+
+        bool operator==(const VertexKey &other) const
+        {
+            return position == other.position && uv == other.uv && normal == other.normal;
+        }
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey &key) const
+        {
+            return ((size_t)key.position * 73856093) ^ ((size_t)key.uv * 19349663) ^ ((size_t)key.normal * 83492791);
+        }
+    };
+
+    // OBJ indices are 1-based, negative ones count back from the end
+    int resolveIndex(int index, size_t count)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return (int)count + index;
+        return -1;
+    }
+
+    // Parses "v", "v/vt", "v//vn" or "v/vt/vn"
+    bool parseFaceVertex(const std::string &token, size_t positionCount, size_t uvCount, size_t normalCount, VertexKey &key)
+    {
+        const char *cursor = token.c_str();
+        char *end;
+
+        key.position = resolveIndex(std::strtol(cursor, &end, 10), positionCount);
+        key.uv = key.normal = -1;
+        if (end == cursor || key.position < 0 || key.position >= (int)positionCount)
+            return false;
+
+        if (*end == '/')
+        {
+            cursor = end + 1;
+            if (*cursor != '/')
+            {
+                key.uv = resolveIndex(std::strtol(cursor, &end, 10), uvCount);
+                if (key.uv >= (int)uvCount)
+                    key.uv = -1;
+            }
+            else
+                end = (char *)cursor;
+
+            if (*end == '/')
+            {
+                key.normal = resolveIndex(std::strtol(end + 1, &end, 10), normalCount);
+                if (key.normal >= (int)normalCount)
+                    key.normal = -1;
+            }
+        }
+
+        return true;
+    }
+}
+
+std::shared_ptr<TriangleMesh> TriangleMesh::LoadOBJ(const std::string &name, const std::string &filePath, uint32_t materialId)
+{
+    std::ifstream file(filePath);
+    if (!file)
+    {
+        std::cout << "error loading mesh " << filePath << std::endl;
+        return nullptr;
+    }
+
+    std::vector<glm::vec3> filePositions, fileNormals;
+    std::vector<glm::vec2> fileUVs;
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint32_t> indices;
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertexLookup;
+    bool hasNormals = true, hasUVs = true;
+
+    std::string line, keyword, token;
+    std::vector<uint32_t> polygon;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        if (!(stream >> keyword))
+            continue;
+
+        if (keyword == "v")
+        {
+            glm::vec3 p;
+            stream >> p.x >> p.y >> p.z;
+            filePositions.push_back(p);
+        }
+        else if (keyword == "vn")
+        {
+            glm::vec3 n;
+            stream >> n.x >> n.y >> n.z;
+            fileNormals.push_back(n);
+        }
+        else if (keyword == "vt")
+        {
+            glm::vec2 uv;
+            stream >> uv.x >> uv.y;
+            fileUVs.push_back(uv);
+        }
+        else if (keyword == "f")
+        {
+            polygon.clear();
+            while (stream >> token)
+            {
+                VertexKey key;
+                if (!parseFaceVertex(token, filePositions.size(), fileUVs.size(), fileNormals.size(), key))
+                    break;
+
+                auto found = vertexLookup.find(key);
+                if (found == vertexLookup.end())
+                {
+                    found = vertexLookup.emplace(key, (uint32_t)positions.size()).first;
+                    positions.push_back(filePositions[key.position]);
+                    normals.push_back(key.normal >= 0 ? fileNormals[key.normal] : glm::vec3(0.0f));
+                    uvs.push_back(key.uv >= 0 ? fileUVs[key.uv] : glm::vec2(0.0f));
+                    hasNormals &= key.normal >= 0;
+                    hasUVs &= key.uv >= 0;
+                }
+                polygon.push_back(found->second);
+            }
+
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                indices.push_back(polygon[0]);
+                indices.push_back(polygon[i - 1]);
+                indices.push_back(polygon[i]);
+            }
+        }
+    }
+
+    if (indices.empty())
+    {
+        std::cout << "error loading mesh " << filePath << ": no faces" << std::endl;
+        return nullptr;
+    }
+
+    // Partial attributes are dropped rather than interpolated against zeros
+    if (!hasNormals)
+        normals.clear();
+    if (!hasUVs)
+        uvs.clear();
+
+    return std::make_shared<TriangleMesh>(name, std::move(positions), std::move(normals), std::move(uvs), std::move(indices), materialId);
+}
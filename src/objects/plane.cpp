@@ -1,4 +1,6 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "objects/plane.h"
 
@@ -7,8 +9,8 @@
 
 // }
 
-Plane::Plane(const std::string &name, glm::vec3 position, glm::vec3 normal, std::shared_ptr<Material> mat)
-    : position(position), normal(-normal), mat(mat), Hittable(name)
+Plane::Plane(const std::string &name, glm::vec3 position, glm::vec3 normal, uint32_t materialId)
+    : position(position), normal(-normal), materialId(materialId), Hittable(name)
 {
     for (int i = 0; i < 6; i++)
     {
@@ -20,34 +22,39 @@ Plane::Plane(const std::string &name, glm::vec3 position, glm::vec3 normal, std:
     }
 }
 
-bool Plane::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+bool Plane::intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const
 {
     float denominator = glm::dot(normal, ray.direction);
-    if (glm::abs(denominator) > 1e-6)
-    {
-        glm::vec3 p = position - ray.origin;
-        float t = glm::dot(p, normal) / denominator;
-
-        if (t < tMin || tMax < t)
-            return false;
-
-        glm::vec3 a = glm::cross(normal, glm::vec3(1, 0, 0));
-        glm::vec3 b = glm::cross(normal, glm::vec3(0, 1, 0));
-        glm::vec3 max_ab = glm::dot(a, a) < glm::dot(b, b) ? b : a;
-        glm::vec3 c = glm::cross(normal, glm::vec3(0, 0, 1));
-
-        glm::vec3 uVec = glm::normalize(glm::dot(max_ab, max_ab) < glm::dot(c, c) ? c : max_ab);
-        glm::vec3 vVec = glm::cross(normal, uVec);
-
-        payload.worldPosition = ray.origin + t * ray.direction;
-        payload.hitDistance = t;
-        payload.setFaceNormal(ray, normal);
-        payload.mat = mat;
-        payload.u = glm::dot(payload.worldPosition - position, uVec);
-        payload.v = glm::dot(payload.worldPosition - position, vVec);
-        return t >= 0;
-    }
-    return false;
+    if (glm::abs(denominator) <= 1e-6)
+        return false;
+
+    glm::vec3 p = position - ray.origin;
+    float t = glm::dot(p, normal) / denominator;
+    if (t < tMin || tMax < t || t < 0)
+        return false;
+
+    intersection.t = t;
+    intersection.primitiveId = 0;
+    intersection.object = this;
+    return true;
+}
+
+void Plane::computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const
+{
+    glm::vec3 a = glm::cross(normal, glm::vec3(1, 0, 0));
+    glm::vec3 b = glm::cross(normal, glm::vec3(0, 1, 0));
+    glm::vec3 max_ab = glm::dot(a, a) < glm::dot(b, b) ? b : a;
+    glm::vec3 c = glm::cross(normal, glm::vec3(0, 0, 1));
+
+    glm::vec3 uVec = glm::normalize(glm::dot(max_ab, max_ab) < glm::dot(c, c) ? c : max_ab);
+    glm::vec3 vVec = glm::cross(normal, uVec);
+
+    payload.worldPosition = ray.origin + intersection.t * ray.direction;
+    payload.hitDistance = intersection.t;
+    payload.setFaceNormal(ray, normal);
+    payload.materialId = materialId;
+    payload.u = glm::dot(payload.worldPosition - position, uVec);
+    payload.v = glm::dot(payload.worldPosition - position, vVec);
 }
 
 bool Plane::boundingBox(AABB &outputBox) const
@@ -55,6 +62,12 @@ bool Plane::boundingBox(AABB &outputBox) const
     return false;
 }
 
+bool Plane::material(uint32_t &outputId) const
+{
+    outputId = materialId;
+    return true;
+}
+
 glm::vec3 Plane::directionNormals[6] = {
     glm::vec3(-1.0f, 0.0f, 0.0f),
     glm::vec3(1.0f, 0.0f, 0.0f),
@@ -66,6 +79,7 @@ glm::vec3 Plane::directionNormals[6] = {
 
 const char *Plane::availableNormals[6] = {"LEFT", "RIGHT", "UP", "DOWN", "FRONT", "BACK"};
 
+#ifndef RAYZ_HEADLESS
 bool Plane::renderUI()
 {
     bool moved = false;
@@ -103,14 +117,9 @@ bool Plane::renderUI()
         }
     }
 
-    {
-        ImGui::SeparatorText("Mat");
-        if (mat->renderUI())
-            moved = true;
-    }
-
     return moved;
 }
+#endif
 
 // std::shared_ptr<Hittable> Plane::CreatePlane(const std::string &name)
 // {
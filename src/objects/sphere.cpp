@@ -1,19 +1,20 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "objects/sphere.h"
-#include "materials/lambertian.h"
 
-Sphere::Sphere(const std::string &name)
-    : Hittable(name), center(0.0f), radius(0.5f), mat(std::make_shared<Lambertian>(glm::vec3(1.0f, 0.0f, 0.0f)))
+Sphere::Sphere(const std::string &name, uint32_t materialId)
+    : Hittable(name), center(0.0f), radius(0.5f), materialId(materialId)
 {
 }
 
-Sphere::Sphere(const std::string &name, glm::vec3 center, float radius, std::shared_ptr<Material> mat)
-    : center(center), radius(radius), mat(mat), Hittable(name)
+Sphere::Sphere(const std::string &name, glm::vec3 center, float radius, uint32_t materialId)
+    : center(center), radius(radius), materialId(materialId), Hittable(name)
 {
 }
 
-bool Sphere::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+bool Sphere::intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const
 {
     glm::vec3 origin = ray.origin - center;
     float a = glm::dot(ray.direction, ray.direction);
@@ -33,20 +34,26 @@ bool Sphere::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) co
             return false;
     }
 
-    payload.hitDistance = t;
-    payload.worldPosition = ray.origin + t * ray.direction;
+    intersection.t = t;
+    intersection.primitiveId = 0;
+    intersection.object = this;
+    return true;
+}
+
+void Sphere::computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const
+{
+    payload.hitDistance = intersection.t;
+    payload.worldPosition = ray.origin + intersection.t * ray.direction;
     glm::vec3 normal = (payload.worldPosition - center) / radius;
     // glm::vec3 normal = glm::normalize(payload.worldPosition - center);
     payload.setFaceNormal(ray, normal);
-    payload.mat = mat;
+    payload.materialId = materialId;
 
     payload.u = glm::atan(normal.x, normal.z) / (2.0f * glm::pi<float>()) + 0.5f;
     payload.v = normal.y * 0.5 + 0.5;
 
     // payload.u = (atan2(normal.x, -normal.z) / glm::pi<float>() + 1.0f) / 2.0f;
     // payload.v = asin(normal.y) / glm::pi<float>() + .5;
-
-    return true;
 }
 
 bool Sphere::boundingBox(AABB &outputBox) const
@@ -55,6 +62,33 @@ bool Sphere::boundingBox(AABB &outputBox) const
     return true;
 }
 
+bool Sphere::material(uint32_t &outputId) const
+{
+    outputId = materialId;
+    return true;
+}
+
+uint32_t Sphere::getSampleablePrimitiveCount() const
+{
+    return 1;
+}
+
+float Sphere::getPrimitiveArea(uint32_t primitiveId) const
+{
+    return 4.0f * glm::pi<float>() * radius * radius;
+}
+
+void Sphere::samplePrimitive(uint32_t primitiveId, const glm::vec2 &u, glm::vec3 &position, glm::vec3 &normal, glm::vec2 &uv) const
+{
+    float z = 1.0f - 2.0f * u.x;
+    float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+    float phi = 2.0f * glm::pi<float>() * u.y;
+    normal = glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+    position = center + radius * normal;
+    uv = glm::vec2(glm::atan(normal.x, normal.z) / (2.0f * glm::pi<float>()) + 0.5f, normal.y * 0.5f + 0.5f);
+}
+
+#ifndef RAYZ_HEADLESS
 bool Sphere::renderUI()
 {
     bool moved = false;
@@ -73,15 +107,11 @@ bool Sphere::renderUI()
             ImGui::SetTooltip("Radius");
         }
     }
-    {
-        ImGui::SeparatorText("Mat");
-        if (mat->renderUI())
-            moved = true;
-    }
     return moved;
 }
+#endif
 
-std::shared_ptr<Hittable> Sphere::CreateSphere(const std::string &name)
+std::shared_ptr<Hittable> Sphere::CreateSphere(const std::string &name, uint32_t materialId)
 {
-    return std::make_shared<Sphere>(name);
+    return std::make_shared<Sphere>(name, materialId);
 }
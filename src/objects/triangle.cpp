@@ -1,64 +1,18 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "objects/triangle.h"
 
-Triangle::Triangle(const std::string &name, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, std::shared_ptr<Material> mat)
-    : v0(v0), v1(v1), v2(v2), mat(mat), Hittable(name)
+Triangle::Triangle(const std::string &name, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, uint32_t materialId)
+    : v0(v0), v1(v1), v2(v2), materialId(materialId), Hittable(name)
 {
 }
-#define MT
-#ifndef MT
-bool Triangle::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
-{
-    glm::vec3 v0v1 = v1 - v0;
-    glm::vec3 v0v2 = v2 - v0;
-    glm::vec3 normal = glm::cross(v0v1, v0v2);
-    float area = normal.length() / 2.0f;
-
-    float p = glm::dot(normal, ray.direction);
-    if (glm::abs(p) < 1e-6)
-        return false;
 
-    float d = -glm::dot(normal, v0);
-    float t = -(glm::dot(normal, ray.origin) + d);
-
-    // if (t < 0)
-    //     return false;
-
-    if (t < tMin || tMax < t)
-        return false;
-
-    payload.worldPosition = ray.origin + t * ray.direction;
-    payload.hitDistance = t;
-    payload.mat = mat;
-    payload.setFaceNormal(ray, normal);
-
-    glm::vec3 edge0 = v1 - v0;
-    glm::vec3 vp0 = payload.worldPosition - v0;
-    glm::vec3 C1 = glm::cross(edge0, vp0);
-    if (glm::dot(normal, C1) < 0)
-        return false;
-
-    glm::vec3 edge1 = v2 - v1;
-    glm::vec3 vp1 = payload.worldPosition - v1;
-    glm::vec3 C2 = glm::cross(edge1, vp1);
-    if (glm::dot(normal, C2) < 0)
-        return false;
-
-    glm::vec3 edge2 = v0 - v2;
-    glm::vec3 vp2 = payload.worldPosition - v2;
-    glm::vec3 C3 = glm::cross(edge2, vp2);
-    if (glm::dot(normal, C3) < 0)
-        return false;
-
-    return true;
-}
-#else
-bool Triangle::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+bool Triangle::intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const
 {
     glm::vec3 v0v1 = v1 - v0;
     glm::vec3 v0v2 = v2 - v0;
-    glm::vec3 normal = glm::normalize(glm::cross(v0v1, v0v2));
     glm::vec3 p = glm::cross(ray.direction, v0v2);
     float det = glm::dot(v0v1, p);
 
@@ -82,16 +36,25 @@ bool Triangle::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload)
     if (t < tMin || tMax < t)
         return false;
 
-    payload.worldPosition = ray.origin + t * ray.direction;
-    payload.hitDistance = t;
-    payload.mat = mat;
-    payload.setFaceNormal(ray, normal);
-    payload.u = u;
-    payload.v = v;
-
+    intersection.t = t;
+    intersection.primitiveId = 0;
+    intersection.u = u;
+    intersection.v = v;
+    intersection.object = this;
     return true;
 }
-#endif
+
+void Triangle::computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const
+{
+    glm::vec3 normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+
+    payload.worldPosition = ray.origin + intersection.t * ray.direction;
+    payload.hitDistance = intersection.t;
+    payload.materialId = materialId;
+    payload.setFaceNormal(ray, normal);
+    payload.u = intersection.u;
+    payload.v = intersection.v;
+}
 
 bool Triangle::boundingBox(AABB &outputBox) const
 {
@@ -99,6 +62,32 @@ bool Triangle::boundingBox(AABB &outputBox) const
     return true;
 }
 
+bool Triangle::material(uint32_t &outputId) const
+{
+    outputId = materialId;
+    return true;
+}
+
+uint32_t Triangle::getSampleablePrimitiveCount() const
+{
+    return 1;
+}
+
+float Triangle::getPrimitiveArea(uint32_t primitiveId) const
+{
+    return 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
+}
+
+void Triangle::samplePrimitive(uint32_t primitiveId, const glm::vec2 &u, glm::vec3 &position, glm::vec3 &normal, glm::vec2 &uv) const
+{
+    // Square root warp keeps the density uniform over the area
+    float su = glm::sqrt(u.x);
+    uv = glm::vec2(su * (1.0f - u.y), su * u.y);
+    position = (1.0f - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
+    normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+}
+
+#ifndef RAYZ_HEADLESS
 bool Triangle::renderUI()
 {
     bool moved = false;
@@ -124,15 +113,9 @@ bool Triangle::renderUI()
         }
     }
 
-    {
-        ImGui::SeparatorText("Mat");
-        if (mat)
-            if (mat->renderUI())
-                moved = true;
-    }
-
     return moved;
 }
+#endif
 
 // std::shared_ptr<Hittable> Triangle::CreateTriangle(const std::string &name)
 // {
@@ -0,0 +1,216 @@
+#include <algorithm>
+
+#ifndef RAYZ_HEADLESS
+#include "imgui.h"
+#endif
+#include "objects/triangleMesh.h"
+
+TriangleMesh::TriangleMesh(const std::string &name, std::vector<glm::vec3> positions, std::vector<glm::vec3> normals,
+                           std::vector<glm::vec2> uvs, std::vector<uint32_t> indices, uint32_t materialId)
+    : Hittable(name), positions(std::move(positions)), normals(std::move(normals)), uvs(std::move(uvs)), indices(std::move(indices)), materialId(materialId)
+{
+    build();
+}
+
+void TriangleMesh::build()
+{
+    std::vector<AABB> triangleBounds(getTriangleCount());
+    for (uint32_t i = 0; i < triangleBounds.size(); i++)
+    {
+        const glm::vec3 &v0 = positions[indices[3 * i]];
+        const glm::vec3 &v1 = positions[indices[3 * i + 1]];
+        const glm::vec3 &v2 = positions[indices[3 * i + 2]];
+        triangleBounds[i] = AABB(glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2)));
+    }
+
+    bvh.build(triangleBounds, TriangleBlock::width, TriangleBlock::width);
+    if (!bvh.empty())
+        bounds = AABB(bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax);
+
+    // Repack every leaf into SoA blocks, normally exactly one per leaf
+    blocks.clear();
+    leafBlocks.assign(bvh.nodes.size(), 0);
+    for (uint32_t nodeIndex = 0; nodeIndex < bvh.nodes.size(); nodeIndex++)
+    {
+        const BVHNode &node = bvh.nodes[nodeIndex];
+        if (!node.isLeaf())
+            continue;
+
+        leafBlocks[nodeIndex] = blocks.size();
+        for (uint32_t i = 0; i < node.count; i++)
+        {
+            if (i % TriangleBlock::width == 0)
+                blocks.emplace_back();
+
+            uint32_t triangle = bvh.primitiveIndices[node.leftFirst + i];
+            blocks.back().set(i % TriangleBlock::width, positions[indices[3 * triangle]], positions[indices[3 * triangle + 1]],
+                              positions[indices[3 * triangle + 2]], triangle);
+        }
+    }
+}
+
+uint32_t TriangleMesh::getTriangleCount() const
+{
+    return indices.size() / 3;
+}
+
+const BVH::BuildStats &TriangleMesh::getBuildStats() const
+{
+    return bvh.getBuildStats();
+}
+
+bool TriangleMesh::intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const
+{
+    return bvh.traverseLeaves(ray, tMin, tMax, [&](uint32_t nodeIndex, float &tMaxRef)
+                              {
+                                  uint32_t first = leafBlocks[nodeIndex];
+                                  uint32_t last = first + (bvh.nodes[nodeIndex].count + TriangleBlock::width - 1) / TriangleBlock::width;
+                                  bool hitLeaf = false;
+                                  for (uint32_t b = first; b < last; b++)
+                                  {
+                                      float t, u, v;
+                                      int lane = blocks[b].intersect(ray, tMin, tMaxRef, t, u, v);
+                                      if (lane < 0)
+                                          continue;
+                                      tMaxRef = t;
+                                      intersection = {t, blocks[b].triangle[lane], u, v, this};
+                                      hitLeaf = true;
+                                  }
+                                  return hitLeaf; });
+}
+
+bool TriangleMesh::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    return bvh.traverseLeaves(ray, tMin, tMax, [&](uint32_t nodeIndex, float &tMaxRef)
+                              {
+                                  uint32_t first = leafBlocks[nodeIndex];
+                                  uint32_t last = first + (bvh.nodes[nodeIndex].count + TriangleBlock::width - 1) / TriangleBlock::width;
+                                  for (uint32_t b = first; b < last; b++)
+                                  {
+                                      float t, u, v;
+                                      if (blocks[b].intersect(ray, tMin, tMaxRef, t, u, v) < 0)
+                                          continue;
+                                      tMaxRef = -std::numeric_limits<float>::max();
+                                      return true;
+                                  }
+                                  return false; });
+}
+
+uint64_t TriangleMesh::intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const
+{
+    uint64_t hitMask = 0;
+
+    bvh.traversePacket(packet, tMin, [&](uint32_t nodeIndex, uint32_t leafFirstActive)
+                       {
+                           const BVHNode &leaf = bvh.nodes[nodeIndex];
+                           uint32_t first = leafBlocks[nodeIndex];
+                           uint32_t last = first + (leaf.count + TriangleBlock::width - 1) / TriangleBlock::width;
+                           for (uint32_t i = std::max(firstActive, leafFirstActive); i < packet.count; i++)
+                           {
+                               if (BVH::intersectBox(leaf, packet.origin, packet.invDirections[i], tMin, packet.tMax[i]) == std::numeric_limits<float>::infinity())
+                                   continue;
+
+                               Ray ray = packet.getRay(i);
+                               for (uint32_t b = first; b < last; b++)
+                               {
+                                   float t, u, v;
+                                   int lane = blocks[b].intersect(ray, tMin, packet.tMax[i], t, u, v);
+                                   if (lane < 0)
+                                       continue;
+                                   packet.tMax[i] = t;
+                                   intersections[i] = {t, blocks[b].triangle[lane], u, v, this};
+                                   hitMask |= 1ull << i;
+                               }
+                           } });
+
+    return hitMask;
+}
+
+void TriangleMesh::computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const
+{
+    uint32_t triangle = intersection.primitiveId;
+    float t = intersection.t, u = intersection.u, v = intersection.v;
+    uint32_t i0 = indices[3 * triangle];
+    uint32_t i1 = indices[3 * triangle + 1];
+    uint32_t i2 = indices[3 * triangle + 2];
+    float w = 1.0f - u - v;
+
+    glm::vec3 geometricNormal = glm::normalize(glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]));
+    glm::vec3 shadingNormal = geometricNormal;
+    if (!normals.empty())
+        shadingNormal = glm::normalize(w * normals[i0] + u * normals[i1] + v * normals[i2]);
+
+    payload.hitDistance = t;
+    payload.worldPosition = ray.origin + t * ray.direction;
+    payload.frontFace = glm::dot(ray.direction, geometricNormal) < 0;
+    payload.worldNormal = payload.frontFace ? shadingNormal : -shadingNormal;
+    payload.geometricNormal = payload.frontFace ? geometricNormal : -geometricNormal;
+    payload.materialId = materialId;
+
+    if (!uvs.empty())
+    {
+        glm::vec2 uv = w * uvs[i0] + u * uvs[i1] + v * uvs[i2];
+        payload.u = uv.x;
+        payload.v = uv.y;
+    }
+    else
+    {
+        payload.u = u;
+        payload.v = v;
+    }
+}
+
+bool TriangleMesh::boundingBox(AABB &outputBox) const
+{
+    if (bvh.empty())
+        return false;
+
+    outputBox = bounds;
+    return true;
+}
+
+bool TriangleMesh::material(uint32_t &outputId) const
+{
+    outputId = materialId;
+    return true;
+}
+
+uint32_t TriangleMesh::getSampleablePrimitiveCount() const
+{
+    return getTriangleCount();
+}
+
+float TriangleMesh::getPrimitiveArea(uint32_t primitiveId) const
+{
+    const glm::vec3 &p0 = positions[indices[3 * primitiveId]];
+    return 0.5f * glm::length(glm::cross(positions[indices[3 * primitiveId + 1]] - p0, positions[indices[3 * primitiveId + 2]] - p0));
+}
+
+void TriangleMesh::samplePrimitive(uint32_t primitiveId, const glm::vec2 &u, glm::vec3 &position, glm::vec3 &normal, glm::vec2 &uv) const
+{
+    uint32_t i0 = indices[3 * primitiveId];
+    uint32_t i1 = indices[3 * primitiveId + 1];
+    uint32_t i2 = indices[3 * primitiveId + 2];
+
+    float su = glm::sqrt(u.x);
+    float b1 = su * (1.0f - u.y), b2 = su * u.y, b0 = 1.0f - b1 - b2;
+    position = b0 * positions[i0] + b1 * positions[i1] + b2 * positions[i2];
+    normal = glm::normalize(glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]));
+    uv = uvs.empty() ? glm::vec2(b1, b2) : b0 * uvs[i0] + b1 * uvs[i1] + b2 * uvs[i2];
+}
+
+#ifndef RAYZ_HEADLESS
+bool TriangleMesh::renderUI()
+{
+    bool moved = false;
+    {
+        ImGui::SeparatorText("Props");
+        const auto &stats = bvh.getBuildStats();
+        ImGui::Text("Triangles: %u, vertices: %zu", getTriangleCount(), positions.size());
+        ImGui::Text("BVH: %u nodes, depth %u, %.3fms", stats.nodeCount, stats.maxDepth, stats.buildTime);
+        ImGui::Text("Leaf blocks: %zu (%s)", blocks.size(), TriangleBlock::getKernelName());
+    }
+
+    return moved;
+}
+#endif
@@ -1,9 +1,110 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
-#include <execution>
-#include "glm/gtc/random.hpp"
+#include "jug/fileDialog.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "renderer.h"
-#include "jug/fileDialog.h"
+#include "imageWriter.h"
+
+namespace
+{
+    // Rec. 709 luma
+    const glm::vec3 luminanceWeights(0.2126f, 0.7152f, 0.0722f);
+
+    // Extension lower cased and without its dot, empty if there is none
+    void splitExtension(const std::string &filePath, std::string &stem, std::string &extension)
+    {
+        size_t dot = filePath.find_last_of('.');
+        size_t slash = filePath.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        {
+            stem = filePath;
+            extension.clear();
+            return;
+        }
+
+        stem = filePath.substr(0, dot);
+        extension = filePath.substr(dot + 1);
+        for (char &c : extension)
+            c = (char)std::tolower((unsigned char)c);
+    }
+
+    bool isFloatFormat(const std::string &extension)
+    {
+        return extension == "exr" || extension == "pfm";
+    }
+
+    const char checkpointMagic[8] = {'R', 'A', 'Y', 'Z', 'C', 'K', 'P', 'T'};
+    const uint32_t checkpointVersion = 2;
+
+    // Followed by the radiance sums, sample counts and squared luminance of
+    // every pixel, then CheckpointFeatures if features were captured. All in
+    // host byte order. The sample counts also seed the pixels' random
+    // streams, so resumed samples carry on where they stopped.
+    struct CheckpointHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t width, height;
+        int32_t frameIndex;
+        uint64_t sceneHash;
+        float cameraPosition[3];
+        float cameraDirection[3];
+        float verticalFOV;
+        // Settings that change what a sample estimates or which pixels take
+        // samples
+        int32_t maxDepth, rouletteDepth;
+        uint8_t jitter, nextEventEstimation, features, wavefront;
+        float backgroundColor[3];
+        float noiseThreshold;
+        int32_t adaptiveMinSamples;
+    };
+
+    // PixelFeatures with the object as its index in the scene
+    struct CheckpointFeatures
+    {
+        float albedo[3];
+        float normal[3];
+        float depth;
+        uint32_t materialId;
+        uint32_t objectIndex;
+    };
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Sums are written as packed floats");
+
+    // Everything but frameIndex and features, which the renderer fills in
+    CheckpointHeader makeCheckpointHeader(const Renderer::Settings &settings, uint32_t width, uint32_t height, const Scene &scene, const Camera &camera)
+    {
+        CheckpointHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, checkpointMagic, sizeof(checkpointMagic));
+        header.version = checkpointVersion;
+        header.width = width;
+        header.height = height;
+        header.sceneHash = scene.getHash();
+        for (int a = 0; a < 3; a++)
+        {
+            header.cameraPosition[a] = camera.getPosition()[a];
+            header.cameraDirection[a] = camera.getDirection()[a];
+            header.backgroundColor[a] = settings.backgroundColor[a];
+        }
+        header.verticalFOV = camera.getVerticalFOV();
+        header.maxDepth = settings.maxDepth;
+        header.rouletteDepth = settings.rouletteDepth;
+        header.jitter = settings.jitter;
+        header.nextEventEstimation = settings.nextEventEstimation;
+        header.wavefront = settings.wavefront;
+        header.noiseThreshold = settings.noiseThreshold;
+        header.adaptiveMinSamples = settings.adaptiveMinSamples;
+        return header;
+    }
+}
 
 Renderer::Renderer()
 {
@@ -11,32 +112,36 @@ Renderer::Renderer()
 
 void Renderer::onResize(uint32_t width, uint32_t height)
 {
-    if (finalImage)
-    {
-        if (finalImage->getWidth() == width && finalImage->getHeight() == height)
-            return;
+    if (imageDataToTexture && this->width == width && this->height == height)
+        return;
+
+    this->width = width;
+    this->height = height;
 
+#ifndef RAYZ_HEADLESS
+    if (finalImage)
         finalImage->resize(width, height);
-    }
     else
-    {
         finalImage = std::make_shared<Image>(width, height);
-    }
+#endif
 
     delete[] imageDataToTexture;
     imageDataToTexture = new uint32_t[width * height];
 
     delete[] accumulationData;
-    accumulationData = new glm::vec4[width * height];
+    accumulationData = new glm::vec3[width * height];
+
+    delete[] sampleCounts;
+    sampleCounts = new uint32_t[width * height];
 
-    verticalIterator.resize(height);
-    for (int i = 0; i < height; i++)
-        verticalIterator[i] = i;
+    delete[] squaredLuminance;
+    squaredLuminance = new float[width * height];
+
+    delete[] featureData;
+    featureData = new PixelFeatures[width * height];
+    // The denoised image no longer fits
+    denoiseDirty = true;
 
-    horizontalIterator.resize(width);
-    for (int i = 0; i < width; i++)
-        horizontalIterator[i] = i;
-    
     resetFrameIndex();
 }
 
@@ -45,45 +150,118 @@ void Renderer::render(const Scene &scene, const Camera &camera)
     activeCamera = &camera;
     activeScene = &scene;
 
+    auto start = std::chrono::steady_clock::now();
+    const bool wasChanging = changing && settings.dynamicResolution;
+
+    // Without accumulation every frame starts from zero samples again, the
+    // offset keeps its streams apart from the previous frames'
+    renderedFrames++;
+    sampleSeedOffset = settings.accumulate ? 0 : renderedFrames * maxAdaptivePasses;
+    changing = false;
+
+    // Budget driven stride while changing, then halved every still frame
+    uint32_t stride = 1;
+    if (settings.dynamicResolution)
+        stride = wasChanging ? (uint32_t)std::lround(previewStrideTarget) : previewStride / 2;
+
+    if (stride > 1)
+    {
+        renderPreview(stride);
+#ifndef RAYZ_HEADLESS
+        finalImage->setData(imageDataToTexture);
+#endif
+    }
+    else
+    {
+        previewStride = 1;
+        renderFrame();
+    }
+
+    if (wasChanging)
+    {
+        // Cost goes with the traced pixel count, 1 / stride^2
+        float frameTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        float target = (float)std::max(stride, 1u) * glm::sqrt(frameTime / glm::max(settings.frameBudget, 1.0f));
+        previewStrideTarget = glm::clamp(target, 1.0f, (float)maxPreviewStride);
+    }
+}
+
+bool Renderer::wantsFeatures() const
+{
+    return settings.denoise || settings.aovs || settings.displayAOV != AOV::BEAUTY;
+}
+
+void Renderer::renderFrame()
+{
+    // Feature sums must cover every sample, start over when they begin
+    const bool wantFeatures = wantsFeatures();
+    if (wantFeatures != captureFeatures)
+    {
+        captureFeatures = wantFeatures;
+        if (captureFeatures)
+            frameIndex = 1;
+    }
+
     if (frameIndex == 1)
-        memset(accumulationData, 0, finalImage->getWidth() * finalImage->getHeight() * sizeof(glm::vec4));
+    {
+        const size_t pixelCount = (size_t)width * height;
+        std::fill(accumulationData, accumulationData + pixelCount, glm::vec3(0.0f));
+        std::fill(sampleCounts, sampleCounts + pixelCount, 0u);
+        std::fill(squaredLuminance, squaredLuminance + pixelCount, 0.0f);
+        std::fill(featureData, featureData + pixelCount, PixelFeatures{});
+    }
 
-#ifndef MT
-    for (int y = 0; y < finalImage->getHeight(); y++)
+    const bool tracing = frameIndex < settings.maxFrames;
+    if (tracing)
     {
-        for (int x = 0; x < finalImage->getWidth(); x++)
+        scheduler.setTiles(width, height, settings.tileSize);
+#ifdef MT
+        scheduler.setWorkerCount(settings.workerCount);
+#endif
+        prepareAdaptiveSampling();
+        if (dirtyTiles.size() != scheduler.getTiles().size())
+            dirtyTiles.assign(scheduler.getTiles().size(), 1);
+        if (settings.wavefront)
         {
-            auto color = perPixel(x, y);
-            if (frameIndex < settings.maxFrames)
-                accumulationData[x + y * finalImage->getWidth()] += color;
-
-            glm::vec4 accumulatedColor = accumulationData[x + y * finalImage->getWidth()];
-            accumulatedColor /= (float)frameIndex;
-            accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
-            imageDataToTexture[x + y * finalImage->getWidth()] = convertToABGR(accumulatedColor);
+            WavefrontIntegrator::Options options;
+            options.jitter = settings.jitter;
+            options.nextEventEstimation = settings.nextEventEstimation;
+            options.rouletteDepth = settings.rouletteDepth;
+            options.maxDepth = settings.maxDepth;
+            options.backgroundColor = settings.backgroundColor;
+            options.features = captureFeatures;
+            options.sampleOffset = sampleSeedOffset;
+            wavefront.render(*activeScene, *activeCamera, width, height, sampleCounts, options, scheduler);
         }
-    }
+
+#ifndef MT
+        for (const auto &tile : scheduler.getTiles())
+            renderTile(tile);
 #else
-    std::for_each(std::execution::par, verticalIterator.begin(), verticalIterator.end(),
-                  [this](int y)
-                  {
-                      std::for_each(std::execution::par, horizontalIterator.begin(), horizontalIterator.end(),
-                                    [this, y](int x)
-                                    {
-                                        if (frameIndex < settings.maxFrames)
-                                        {
-                                            auto color = perPixel(x, y);
-                                            accumulationData[x + y * finalImage->getWidth()] += color;
-
-                                            glm::vec4 accumulatedColor = accumulationData[x + y * finalImage->getWidth()];
-                                            accumulatedColor /= (float)frameIndex;
-                                            accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
-                                            imageDataToTexture[x + y * finalImage->getWidth()] = convertToABGR(accumulatedColor);
-                                        }
-                                    });
-                  });
+        scheduler.run([this](const Tile &tile, uint32_t worker)
+                      { renderTile(tile); });
 #endif
+    }
+
+    // Once per frame, however many samples the tiles took
+    if (settings.displayAOV != AOV::BEAUTY)
+        displayAOV();
+    else if (!settings.denoise)
+        resolveImage();
+    else
+    {
+        if (tracing)
+        {
+            denoiseDirty = true;
+            framesSinceDenoise++;
+        }
+        if (isDenoiseDue(tracing))
+            denoiseImage();
+    }
+
+#ifndef RAYZ_HEADLESS
     finalImage->setData(imageDataToTexture);
+#endif
 
     if (settings.accumulate)
     {
@@ -92,42 +270,740 @@ void Renderer::render(const Scene &scene, const Camera &camera)
     }
     else
         frameIndex = 1;
+
+    if (tracing && settings.accumulate && !settings.checkpointPath.empty())
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<float>(now - lastCheckpoint).count() >= settings.checkpointInterval)
+        {
+            if (!saveCheckpoint(settings.checkpointPath, *activeScene, *activeCamera))
+                std::fprintf(stderr, "Failed to write checkpoint %s\n", settings.checkpointPath.c_str());
+            lastCheckpoint = now;
+        }
+    }
+}
+
+void Renderer::resolveImage()
+{
+    const auto &tiles = scheduler.getTiles();
+    std::vector<uint32_t> pending;
+    for (uint32_t i = 0; i < dirtyTiles.size() && i < tiles.size(); i++)
+    {
+        if (dirtyTiles[i])
+            pending.push_back(i);
+        dirtyTiles[i] = 0;
+    }
+
+    auto resolveTile = [this, &tiles](uint32_t tileIndex)
+    {
+        const Tile &tile = tiles[tileIndex];
+        for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+        {
+            const uint32_t row = tile.x + y * width;
+            tonemapper.resolveRow(&accumulationData[row], &sampleCounts[row], tile.width, &imageDataToTexture[row]);
+        }
+    };
+
+#ifndef MT
+    for (uint32_t tileIndex : pending)
+        resolveTile(tileIndex);
+#else
+    // Not run(), that would overwrite the tile times of the samples
+    scheduler.parallelFor(pending.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t worker)
+                          {
+                              for (uint32_t i = begin; i < end; i++)
+                                  resolveTile(pending[i]); });
+#endif
+}
+
+bool Renderer::isDenoiseDue(bool tracing) const
+{
+    if (!denoiseDirty || settings.denoiseInterval <= 0)
+        return false;
+    if (denoiseRequested || !tracing)
+        return true;
+
+    // The image changes fastest in its first samples
+    const bool powerOfTwo = (frameIndex & (frameIndex - 1)) == 0;
+    return powerOfTwo || framesSinceDenoise >= settings.denoiseInterval;
+}
+
+void Renderer::denoiseImage()
+{
+    denoiser.denoise(accumulationData, sampleCounts, squaredLuminance, featureData, width, height, scheduler);
+    if (settings.displayAOV == AOV::BEAUTY)
+        tonemapper.resolveRow(denoiser.getOutput(), nullptr, width * height, imageDataToTexture);
+    denoiseDirty = false;
+    denoiseRequested = false;
+    framesSinceDenoise = 0;
+}
+
+void Renderer::invalidateDisplay()
+{
+    std::fill(dirtyTiles.begin(), dirtyTiles.end(), 1);
+    denoiseDirty = true;
+    denoiseRequested = true;
+}
+
+void Renderer::displayAOV()
+{
+    std::vector<uint32_t> pixels;
+    getAOVImage(settings.displayAOV, pixels);
+    std::copy(pixels.begin(), pixels.end(), imageDataToTexture);
+}
+
+const char *Renderer::getAOVName(AOV aov)
+{
+    static const char *names[(int)AOV::COUNT] = {"beauty", "albedo", "normal", "depth", "material", "object", "samples"};
+    return names[(int)aov];
+}
+
+void Renderer::getAOV(AOV aov, std::vector<glm::vec4> &values) const
+{
+    values.resize(width * height);
+    for (uint32_t i = 0; i < width * height; i++)
+        values[i] = getAOVPixel(aov, i);
+}
+
+glm::vec4 Renderer::getAOVPixel(AOV aov, uint32_t index) const
+{
+    const PixelFeatures &features = featureData[index];
+    const float n = glm::max((float)sampleCounts[index], 1.0f);
+    switch (aov)
+    {
+    case AOV::BEAUTY:
+        if (settings.denoise && !denoiseDirty)
+            return glm::vec4(denoiser.getOutput()[index], 1.0f);
+        return glm::vec4(accumulationData[index] / n, 1.0f);
+    case AOV::ALBEDO:
+        return glm::vec4(features.albedo / n, 1.0f);
+    case AOV::NORMAL:
+    {
+        float length = glm::length(features.normal);
+        return glm::vec4(length > 0.0f ? features.normal / length : glm::vec3(0.0f), 1.0f);
+    }
+    case AOV::DEPTH:
+        return glm::vec4(features.depth / n, 0.0f, 0.0f, 1.0f);
+    case AOV::MATERIAL_ID:
+        return glm::vec4(features.object ? (float)features.materialId : -1.0f, 0.0f, 0.0f, 1.0f);
+    case AOV::OBJECT_ID:
+    {
+        uint32_t objectIndex = features.object ? activeScene->getObjectIndex(features.object) : Scene::noObject;
+        return glm::vec4(objectIndex != Scene::noObject ? (float)objectIndex : -1.0f, 0.0f, 0.0f, 1.0f);
+    }
+    default:
+        return glm::vec4((float)sampleCounts[index], 0.0f, 0.0f, 1.0f);
+    }
+}
+
+void Renderer::getAOVImage(AOV aov, std::vector<uint32_t> &pixels) const
+{
+    std::vector<glm::vec4> values;
+    getAOV(aov, values);
+
+    // Depth and counts are shown relative to the image's largest
+    float largest = 0.0f;
+    for (const auto &value : values)
+        largest = glm::max(largest, value.x);
+
+    pixels.resize(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        glm::vec4 color = values[i];
+        switch (aov)
+        {
+        case AOV::NORMAL:
+            color = glm::vec4(0.5f * glm::vec3(color) + 0.5f, 1.0f);
+            break;
+        case AOV::DEPTH:
+            color = glm::vec4(glm::vec3(color.x > 0.0f ? 1.0f - color.x / largest : 0.0f), 1.0f);
+            break;
+        case AOV::MATERIAL_ID:
+        case AOV::OBJECT_ID:
+        {
+            // Hashed so neighbouring IDs get unrelated colours
+            uint32_t hash = (uint32_t)(color.x + 1.0f) * 2654435761u;
+            color = color.x < 0.0f ? glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+                                   : glm::vec4((hash >> 24) / 255.0f, ((hash >> 16) & 0xff) / 255.0f, ((hash >> 8) & 0xff) / 255.0f, 1.0f);
+            break;
+        }
+        case AOV::SAMPLE_COUNT:
+            color = glm::vec4(glm::vec3(largest > 0.0f ? color.x / largest : 0.0f), 1.0f);
+            break;
+        default:
+            break;
+        }
+        pixels[i] = convertToABGR(glm::clamp(color, glm::vec4(0.0f), glm::vec4(1.0f)));
+    }
+}
+
+bool Renderer::saveAOVs(const std::string &beautyPath) const
+{
+    std::string stem, extension;
+    splitExtension(beautyPath, stem, extension);
+    const bool floatOutput = isFloatFormat(extension);
+
+    bool saved = true;
+    std::vector<uint32_t> pixels;
+    for (int aov = (int)AOV::ALBEDO; aov < (int)AOV::COUNT; aov++)
+    {
+        if (!(settings.aovs & (1u << aov)))
+            continue;
+
+        const std::string filePath = stem + "." + getAOVName((AOV)aov) + "." + (floatOutput ? extension : "png");
+        if (floatOutput)
+        {
+            if (!saveFloatImage(filePath, extension, (AOV)aov))
+                saved = false;
+            continue;
+        }
+
+        getAOVImage((AOV)aov, pixels);
+        if (!ImageWriter::writePNG(filePath, width, height, pixels.data()))
+            saved = false;
+    }
+    return saved;
+}
+
+bool Renderer::saveFloatImage(const std::string &filePath, const std::string &extension, AOV aov) const
+{
+    const uint32_t channels = (aov == AOV::BEAUTY || aov == AOV::ALBEDO || aov == AOV::NORMAL) ? 3 : 1;
+    auto rows = [this, aov, channels](uint32_t y, float *row)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            glm::vec4 value = getAOVPixel(aov, x + y * width);
+            for (uint32_t c = 0; c < channels; c++)
+                row[x * channels + c] = value[c];
+        }
+    };
+
+    if (extension == "exr")
+        return ImageWriter::writeEXR(filePath, width, height, channels, rows);
+    return ImageWriter::writePFM(filePath, width, height, channels, rows);
+}
+
+bool Renderer::saveCheckpoint(const std::string &filePath, const Scene &scene, const Camera &camera) const
+{
+    const size_t pixelCount = (size_t)width * height;
+    CheckpointHeader header = makeCheckpointHeader(settings, width, height, scene, camera);
+    header.frameIndex = frameIndex;
+    header.features = captureFeatures;
+
+    const std::string temporaryPath = filePath + ".tmp";
+    FILE *file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   std::fwrite(accumulationData, sizeof(glm::vec3), pixelCount, file) == pixelCount &&
+                   std::fwrite(sampleCounts, sizeof(uint32_t), pixelCount, file) == pixelCount &&
+                   std::fwrite(squaredLuminance, sizeof(float), pixelCount, file) == pixelCount;
+
+    // A row at a time, object pointers become scene indices
+    std::vector<CheckpointFeatures> row(width);
+    for (uint32_t y = 0; y < height && written && captureFeatures; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const PixelFeatures &features = featureData[x + y * width];
+            CheckpointFeatures &stored = row[x];
+            for (int a = 0; a < 3; a++)
+            {
+                stored.albedo[a] = features.albedo[a];
+                stored.normal[a] = features.normal[a];
+            }
+            stored.depth = features.depth;
+            stored.materialId = features.materialId;
+            stored.objectIndex = features.object ? scene.getObjectIndex(features.object) : Scene::noObject;
+        }
+        written = std::fwrite(row.data(), sizeof(CheckpointFeatures), width, file) == width;
+    }
+
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    // rename replaces atomically on POSIX, Windows refuses existing targets
+    if (std::rename(temporaryPath.c_str(), filePath.c_str()) != 0)
+    {
+        std::remove(filePath.c_str());
+        if (std::rename(temporaryPath.c_str(), filePath.c_str()) != 0)
+            return false;
+    }
+    return true;
+}
+
+bool Renderer::loadCheckpoint(const std::string &filePath, const Scene &scene, const Camera &camera)
+{
+    auto fail = [this, &filePath](const char *reason)
+    {
+        checkpointStatus = "Checkpoint " + filePath + ": " + reason;
+        std::fprintf(stderr, "%s\n", checkpointStatus.c_str());
+        return false;
+    };
+
+    FILE *file = std::fopen(filePath.c_str(), "rb");
+    if (!file)
+        return fail("cannot open");
+
+    CheckpointHeader header;
+    CheckpointHeader expected = makeCheckpointHeader(settings, width, height, scene, camera);
+    const char *mismatch = nullptr;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+        mismatch = "not a checkpoint";
+    else if (header.version != expected.version)
+        mismatch = "unsupported version";
+    else if (header.width != expected.width || header.height != expected.height)
+        mismatch = "different image size";
+    else if (header.sceneHash != expected.sceneHash)
+        mismatch = "different scene";
+    else if (std::memcmp(header.cameraPosition, expected.cameraPosition, sizeof(header.cameraPosition)) != 0 ||
+             std::memcmp(header.cameraDirection, expected.cameraDirection, sizeof(header.cameraDirection)) != 0 ||
+             header.verticalFOV != expected.verticalFOV)
+        mismatch = "different camera";
+    else if (header.maxDepth != expected.maxDepth || header.rouletteDepth != expected.rouletteDepth || header.jitter != expected.jitter ||
+             header.nextEventEstimation != expected.nextEventEstimation || header.wavefront != expected.wavefront ||
+             std::memcmp(header.backgroundColor, expected.backgroundColor, sizeof(header.backgroundColor)) != 0 ||
+             header.noiseThreshold != expected.noiseThreshold || header.adaptiveMinSamples != expected.adaptiveMinSamples)
+        mismatch = "different sampling settings";
+    else if (wantsFeatures() && !header.features)
+        mismatch = "no features for denoising or AOVs";
+
+    if (mismatch)
+    {
+        std::fclose(file);
+        return fail(mismatch);
+    }
+
+    const size_t pixelCount = (size_t)width * height;
+    bool read = std::fread(accumulationData, sizeof(glm::vec3), pixelCount, file) == pixelCount &&
+                std::fread(sampleCounts, sizeof(uint32_t), pixelCount, file) == pixelCount &&
+                std::fread(squaredLuminance, sizeof(float), pixelCount, file) == pixelCount;
+
+    std::fill(featureData, featureData + pixelCount, PixelFeatures{});
+    std::vector<CheckpointFeatures> row(width);
+    for (uint32_t y = 0; y < height && read && header.features; y++)
+    {
+        read = std::fread(row.data(), sizeof(CheckpointFeatures), width, file) == width;
+        for (uint32_t x = 0; x < width && read; x++)
+        {
+            const CheckpointFeatures &stored = row[x];
+            PixelFeatures &features = featureData[x + y * width];
+            features.albedo = glm::vec3(stored.albedo[0], stored.albedo[1], stored.albedo[2]);
+            features.normal = glm::vec3(stored.normal[0], stored.normal[1], stored.normal[2]);
+            features.depth = stored.depth;
+            features.materialId = stored.materialId;
+            features.object = stored.objectIndex < scene.objects.size() ? scene.objects[stored.objectIndex].get() : nullptr;
+        }
+    }
+    std::fclose(file);
+
+    if (!read)
+    {
+        resetFrameIndex();
+        return fail("truncated");
+    }
+
+    // The restored features point into this scene, AOVs may be read before
+    // the next render
+    activeScene = &scene;
+    activeCamera = &camera;
+
+    // Carry on without a preview, every tile is resolved and re-estimated
+    frameIndex = header.frameIndex;
+    captureFeatures = header.features;
+    changing = false;
+    tileErrors.clear();
+    invalidateDisplay();
+    lastCheckpoint = std::chrono::steady_clock::now();
+    checkpointStatus = "Resumed " + filePath;
+    return true;
+}
+
+void Renderer::renderPreview(uint32_t stride)
+{
+    previewStride = stride;
+    scheduler.setTiles(width, height, settings.tileSize);
+#ifdef MT
+    scheduler.setWorkerCount(settings.workerCount);
+#endif
+
+#ifndef MT
+    for (const auto &tile : scheduler.getTiles())
+        renderPreviewTile(tile, stride);
+#else
+    scheduler.run([this, stride](const Tile &tile, uint32_t worker)
+                  { renderPreviewTile(tile, stride); });
+#endif
+}
+
+void Renderer::renderPreviewTile(const Tile &tile, uint32_t stride)
+{
+    // Blocks are aligned to the image, so each one is written by the tile
+    // holding its traced pixel even when it reaches into the next tile
+    uint32_t firstX = (tile.x + stride - 1) / stride * stride;
+    uint32_t firstY = (tile.y + stride - 1) / stride * stride;
+    for (uint32_t y = firstY; y < tile.y + tile.height; y += stride)
+    {
+        for (uint32_t x = firstX; x < tile.x + tile.width; x += stride)
+        {
+            glm::vec3 direction;
+            activeCamera->generateRays(x, y, 1, nullptr, &direction);
+            PixelFeatures features = {};
+            glm::vec3 color = perPixel(x, y, direction, features);
+            uint32_t packed;
+            tonemapper.resolveRow(&color, nullptr, 1, &packed);
+
+            for (uint32_t by = y; by < std::min(y + stride, height); by++)
+                for (uint32_t bx = x; bx < std::min(x + stride, width); bx++)
+                    imageDataToTexture[bx + by * width] = packed;
+        }
+    }
+}
+
+void Renderer::prepareAdaptiveSampling()
+{
+    const auto &tiles = scheduler.getTiles();
+    if (frameIndex == 1 || tileErrors.size() != tiles.size())
+        tileErrors.assign(tiles.size(), std::numeric_limits<float>::infinity());
+
+    uint32_t activeTiles = 0;
+    uint64_t activePixels = 0;
+    for (uint32_t i = 0; i < tiles.size(); i++)
+    {
+        if (isTileConverged(i))
+            continue;
+        activeTiles++;
+        activePixels += tiles[i].width * tiles[i].height;
+    }
+
+    activeFraction = (float)activePixels / (float)(width * height);
+    // Keep the rays per frame roughly constant as tiles drop out
+    adaptivePasses = activeTiles ? std::min<uint32_t>(maxAdaptivePasses, tiles.size() / activeTiles) : 1;
+}
+
+bool Renderer::isTileConverged(uint32_t tileIndex) const
+{
+    if (isTileCapped(scheduler.getTiles()[tileIndex]))
+        return true;
+    return settings.noiseThreshold > 0.0f && !settings.wavefront && tileErrors[tileIndex] < settings.noiseThreshold;
+}
+
+bool Renderer::isTileCapped(const Tile &tile) const
+{
+    // Pixels of a tile only differ if the tile size changed mid accumulation
+    for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+        for (uint32_t x = tile.x; x < tile.x + tile.width; x++)
+            if (getSampleIndex(x, y) >= (uint32_t)settings.maxFrames)
+                return true;
+    return false;
+}
+
+float Renderer::estimateTileError(const Tile &tile) const
+{
+    float worstError = 0.0f;
+    for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+    {
+        for (uint32_t x = tile.x; x < tile.x + tile.width; x++)
+        {
+            float n = (float)sampleCounts[x + y * width];
+            if (n < settings.adaptiveMinSamples || n < 2.0f)
+                return std::numeric_limits<float>::infinity();
+
+            float mean = glm::dot(accumulationData[x + y * width], luminanceWeights) / n;
+            float variance = glm::max(0.0f, squaredLuminance[x + y * width] / n - mean * mean) * n / (n - 1.0f);
+            // Relative to the mean, floored so near black pixels can converge
+            float error = glm::sqrt(variance / n) / (mean + 0.1f);
+            worstError = glm::max(worstError, error);
+        }
+    }
+    return worstError;
+}
+
+uint32_t Renderer::getSampleIndex(uint32_t x, uint32_t y) const
+{
+    return sampleCounts[x + y * width] + 1;
+}
+
+uint32_t Renderer::getSampleSeed(uint32_t x, uint32_t y) const
+{
+    return getSampleIndex(x, y) + sampleSeedOffset;
+}
+
+void Renderer::renderTile(const Tile &tile)
+{
+    // Samples are already traced, only accumulate them
+    if (settings.wavefront)
+    {
+        const glm::vec3 *radiance = wavefront.getRadiance();
+        const PixelFeatures *features = wavefront.getFeatures();
+        for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+            for (uint32_t x = tile.x; x < tile.x + tile.width; x++)
+                if (getSampleIndex(x, y) < (uint32_t)settings.maxFrames)
+                    accumulatePixel(x, y, radiance[x + y * width], features[x + y * width]);
+        dirtyTiles[&tile - scheduler.getTiles().data()] = 1;
+        return;
+    }
+
+    const uint32_t tileIndex = &tile - scheduler.getTiles().data();
+    if (isTileConverged(tileIndex))
+        return;
+    dirtyTiles[tileIndex] = 1;
+
+    for (uint32_t pass = 0; pass < adaptivePasses; pass++)
+    {
+        // Extra passes may reach the sample cap before the frame counter does
+        if (pass > 0 && isTileCapped(tile))
+            break;
+        renderTileSample(tile);
+    }
+
+    if (settings.noiseThreshold > 0.0f)
+        tileErrors[tileIndex] = estimateTileError(tile);
+}
+
+void Renderer::renderTileSample(const Tile &tile)
+{
+    if (settings.primaryPackets)
+    {
+        for (uint32_t y = tile.y; y < tile.y + tile.height; y += RayPacket::edge)
+            for (uint32_t x = tile.x; x < tile.x + tile.width; x += RayPacket::edge)
+                renderPacket(x, y, std::min(RayPacket::edge, tile.x + tile.width - x), std::min(RayPacket::edge, tile.y + tile.height - y));
+        return;
+    }
+
+    glm::vec3 directions[RayPacket::size];
+    for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+    {
+        for (uint32_t x = tile.x; x < tile.x + tile.width; x += RayPacket::size)
+        {
+            uint32_t count = std::min(RayPacket::size, tile.x + tile.width - x);
+            generateCameraRays(x, y, count, directions);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                PixelFeatures features = {};
+                glm::vec3 color = perPixel(x + i, y, directions[i], features);
+                accumulatePixel(x + i, y, color, features);
+            }
+        }
+    }
+}
+
+void Renderer::renderPacket(uint32_t x, uint32_t y, uint32_t packetWidth, uint32_t packetHeight)
+{
+    glm::vec3 directions[RayPacket::edge];
+
+    RayPacket packet;
+    packet.origin = activeCamera->getPosition();
+    for (uint32_t j = 0; j < packetHeight; j++)
+    {
+        generateCameraRays(x, y + j, packetWidth, directions);
+        for (uint32_t i = 0; i < packetWidth; i++)
+            packet.add(directions[i]);
+    }
+    packet.finalize();
+
+    HitPayload payloads[RayPacket::size];
+    uint64_t hitMask = activeScene->hitPacket(packet, 0.001f, payloads);
+
+    for (uint32_t i = 0; i < packet.count; i++)
+    {
+        uint32_t pixelX = x + i % packetWidth;
+        uint32_t pixelY = y + i / packetWidth;
+        bool hit = (hitMask >> i) & 1;
+        PixelFeatures features = {};
+        glm::vec3 color = tracePath(pixelX, pixelY, packet.getRay(i), hit, payloads[i], features);
+        accumulatePixel(pixelX, pixelY, color, features);
+    }
+}
+
+void Renderer::accumulatePixel(uint32_t x, uint32_t y, const glm::vec3 &color, const PixelFeatures &features)
+{
+    PixelFeatures &featureSum = featureData[x + y * width];
+    if (sampleCounts[x + y * width] == 0)
+    {
+        featureSum.object = features.object;
+        featureSum.materialId = features.materialId;
+    }
+    featureSum.albedo += features.albedo;
+    featureSum.normal += features.normal;
+    featureSum.depth += features.depth;
+
+    const float luminance = glm::dot(color, luminanceWeights);
+    squaredLuminance[x + y * width] += luminance * luminance;
+    accumulationData[x + y * width] += color;
+    sampleCounts[x + y * width]++;
 }
 
 void Renderer::resetFrameIndex()
 {
     frameIndex = 1;
+    changing = true;
 }
 
+#ifndef RAYZ_HEADLESS
 void Renderer::renderUI()
 {
     ImGui::Begin("Renderer");
 
     ImGui::SeparatorText("Status");
     ImGui::Text("Samples: %d / %d", frameIndex, settings.maxFrames);
+    ImGui::Text("Active pixels: %.1f%%, %u passes per tile", 100.0f * activeFraction, adaptivePasses);
+    ImGui::Text("Preview stride: %u", previewStride);
+
+    auto tileStats = scheduler.getStats();
+    ImGui::Text("Tiles: %d on %u workers, %d steals", tileStats.tileCount, scheduler.getWorkerCount(), tileStats.steals);
+    ImGui::Text("Tile time: %.3f / %.3f / %.3fms", tileStats.minTileTime, tileStats.averageTileTime, tileStats.maxTileTime);
+
+    std::vector<float> tileTimes;
+    for (const auto &tile : scheduler.getTiles())
+        tileTimes.push_back(tile.renderTime);
+    if (!tileTimes.empty())
+        ImGui::PlotLines("Tile times", tileTimes.data(), tileTimes.size(), 0, nullptr, 0.0f, tileStats.maxTileTime, ImVec2(0, 40));
 
     ImGui::SeparatorText("Settings");
     ImGui::Checkbox("Accumulate", &settings.accumulate);
     ImGui::InputInt("Max Sample frames", &settings.maxFrames);
+
+    if (ImGui::InputInt("Tile Size", &settings.tileSize, 8))
+        settings.tileSize = glm::clamp(settings.tileSize, 4, 256);
+    if (ImGui::InputInt("Workers (0 = all)", &settings.workerCount))
+        settings.workerCount = glm::max(settings.workerCount, 0);
+    if (ImGui::Checkbox("Jitter", &settings.jitter))
+        resetFrameIndex();
+    ImGui::Checkbox("Primary ray packets", &settings.primaryPackets);
+    ImGui::Checkbox("Wavefront", &settings.wavefront);
+    if (ImGui::Checkbox("Next event estimation", &settings.nextEventEstimation))
+        resetFrameIndex();
+    if (ImGui::InputInt("Max depth", &settings.maxDepth))
+    {
+        settings.maxDepth = glm::clamp(settings.maxDepth, 1, 256);
+        resetFrameIndex();
+    }
+    if (ImGui::InputInt("Roulette depth", &settings.rouletteDepth))
+    {
+        settings.rouletteDepth = glm::max(settings.rouletteDepth, 1);
+        resetFrameIndex();
+    }
+    if (ImGui::SliderFloat("Noise threshold", &settings.noiseThreshold, 0.0f, 0.1f, "%.4f"))
+        resetFrameIndex();
+    ImGui::Checkbox("Dynamic resolution", &settings.dynamicResolution);
+    if (settings.dynamicResolution && ImGui::InputFloat("Frame budget (ms)", &settings.frameBudget, 1.0f))
+        settings.frameBudget = glm::max(settings.frameBudget, 1.0f);
+    if (settings.wavefront)
+    {
+        const auto &wavefrontStats = wavefront.getStats();
+        ImGui::Text("Segments: %u, shadow rays: %u over %u bounces", wavefrontStats.pathSegments, wavefrontStats.shadowRays, wavefrontStats.bounces);
+        ImGui::Text("Extend / sort / shade / shadow: %.2f / %.2f / %.2f / %.2fms", wavefrontStats.extendTime, wavefrontStats.sortTime,
+                    wavefrontStats.shadeTime, wavefrontStats.shadowTime);
+    }
     if (ImGui::ColorEdit3("Background Color", glm::value_ptr(settings.backgroundColor)))
     {
         resetFrameIndex();
     }
 
+    ImGui::SeparatorText("Denoiser");
+    if (ImGui::Checkbox("Denoise", &settings.denoise))
+        invalidateDisplay();
+    if (settings.denoise)
+    {
+        auto &denoiserSettings = denoiser.getSettings();
+        if (ImGui::SliderInt("Iterations", &denoiserSettings.iterations, 1, 8))
+            invalidateDisplay();
+        if (ImGui::SliderFloat("Color sigma", &denoiserSettings.colorSigma, 0.5f, 16.0f))
+            invalidateDisplay();
+        if (ImGui::SliderFloat("Depth sigma", &denoiserSettings.depthSigma, 0.1f, 8.0f))
+            invalidateDisplay();
+        ImGui::SliderInt("Denoise every", &settings.denoiseInterval, 1, 64, "%d frames");
+        ImGui::Text("Denoise time: %.2fms", denoiser.getStats().denoiseTime);
+    }
+
     ImGui::SeparatorText("Output");
+    int shownAOV = (int)settings.displayAOV;
+    if (ImGui::Combo("Display", &shownAOV, "Beauty\0Albedo\0Normal\0Depth\0Material ID\0Object ID\0Sample count\0"))
+    {
+        settings.displayAOV = (AOV)shownAOV;
+        if (settings.displayAOV != AOV::BEAUTY)
+            displayAOV();
+        else
+            invalidateDisplay();
+    }
+    auto &tonemapperSettings = tonemapper.getSettings();
+    if (ImGui::SliderFloat("Exposure", &tonemapperSettings.exposure, -8.0f, 8.0f, "%.1f stops"))
+        invalidateDisplay();
+    int curve = (int)tonemapperSettings.curve;
+    if (ImGui::Combo("Tone curve", &curve, "Linear\0ACES\0"))
+    {
+        tonemapperSettings.curve = (Tonemapper::Curve)curve;
+        invalidateDisplay();
+    }
+    for (int aov = (int)AOV::ALBEDO; aov < (int)AOV::COUNT; aov++)
+    {
+        bool enabled = settings.aovs & (1u << aov);
+        if (aov > (int)AOV::ALBEDO)
+            ImGui::SameLine();
+        if (ImGui::Checkbox(getAOVName((AOV)aov), &enabled))
+            settings.aovs ^= 1u << aov;
+    }
     if (ImGui::Button("Save"))
     {
         saveImage();
     }
 
+    // Only matches the scene and camera it was saved with
+    if (activeScene && activeCamera)
+    {
+        if (ImGui::Button("Save checkpoint"))
+        {
+            std::string filePath = FileDialog::saveFile("Rayz checkpoint (*.rzc)\0*.rzc\0");
+            if (!filePath.empty())
+                checkpointStatus = (saveCheckpoint(filePath, *activeScene, *activeCamera) ? "Saved " : "Failed to write ") + filePath;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Resume checkpoint"))
+        {
+            std::string filePath = FileDialog::openFile("Rayz checkpoint (*.rzc)\0*.rzc\0");
+            if (!filePath.empty())
+                loadCheckpoint(filePath, *activeScene, *activeCamera);
+        }
+        if (!checkpointStatus.empty())
+            ImGui::Text("%s", checkpointStatus.c_str());
+    }
+
     ImGui::End();
 }
 
 void Renderer::saveImage()
 {
-    std::string filePath = FileDialog::saveFile("PNG (*.png)\0*.png\0");
+    std::string filePath = FileDialog::saveFile("PNG (*.png)\0*.png\0OpenEXR (*.exr)\0*.exr\0PFM (*.pfm)\0*.pfm\0");
     if (!filePath.empty())
-        Image::saveData(filePath.c_str(), finalImage->getWidth(), finalImage->getHeight(), 4, imageDataToTexture, finalImage->getWidth() * sizeof(uint32_t));
+    {
+        saveImage(filePath);
+        saveAOVs(filePath);
+    }
+}
+#endif
+
+bool Renderer::saveImage(const std::string &filePath)
+{
+    std::string stem, extension;
+    splitExtension(filePath, stem, extension);
+    if (settings.denoise && denoiseDirty)
+        denoiseImage();
+    if (isFloatFormat(extension))
+        return saveFloatImage(filePath, extension, AOV::BEAUTY);
+
+    // Resolved again, the display may be showing an AOV
+    std::vector<uint32_t> pixels(width * height);
+    if (settings.denoise)
+        tonemapper.resolveRow(denoiser.getOutput(), nullptr, pixels.size(), pixels.data());
+    else
+        tonemapper.resolveRow(accumulationData, sampleCounts, pixels.size(), pixels.data());
+    return ImageWriter::writePNG(filePath, width, height, pixels.data());
 }
 
 Renderer::Settings &Renderer::getSettings()
@@ -135,50 +1011,105 @@ Renderer::Settings &Renderer::getSettings()
     return settings;
 }
 
+Denoiser::Settings &Renderer::getDenoiserSettings()
+{
+    return denoiser.getSettings();
+}
+
+Tonemapper::Settings &Renderer::getTonemapperSettings()
+{
+    return tonemapper.getSettings();
+}
+
 Renderer::Status Renderer::getStatus()
 {
-    return {frameIndex};
+    return {frameIndex, activeFraction, previewStride, scheduler.getStats(), settings.wavefront ? wavefront.getStats() : WavefrontIntegrator::Stats(),
+            settings.denoise ? denoiser.getStats() : Denoiser::Stats()};
+}
+
+const std::vector<Tile> &Renderer::getTiles() const
+{
+    return scheduler.getTiles();
 }
 
-glm::vec4 Renderer::perPixel(int x, int y)
+void Renderer::generateCameraRays(uint32_t x, uint32_t y, uint32_t count, glm::vec3 *directions) const
 {
-    Ray ray, scattered;
+    if (!settings.jitter)
+    {
+        activeCamera->generateRays(x, y, count, nullptr, directions);
+        return;
+    }
+
+    glm::vec2 jitter[RayPacket::size];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Sampler sampler(x + i + y * width, getSampleSeed(x + i, y));
+        sampler.startBounce(Sampler::cameraBounce);
+        jitter[i] = sampler.next2D();
+    }
+    activeCamera->generateRays(x, y, count, jitter, directions);
+}
+
+glm::vec3 Renderer::perPixel(int x, int y, const glm::vec3 &direction, PixelFeatures &features)
+{
+    Ray ray;
     ray.origin = activeCamera->getPosition();
-    ray.direction = activeCamera->getRayDirections()[x + y * finalImage->getWidth()];
+    ray.direction = direction;
 
     HitPayload payload;
+    bool hit = activeScene->hit(ray, 0.001f, std::numeric_limits<float>::max(), payload);
+    return tracePath(x, y, ray, hit, payload, features);
+}
 
-    float multiplier = 1.0f;
+glm::vec3 Renderer::tracePath(int x, int y, Ray ray, bool hit, HitPayload &payload, PixelFeatures &features)
+{
+    Sampler sampler(x + y * width, getSampleSeed(x, y));
 
     glm::vec3 color(0.0f);
-    glm::vec3 attenuation(1.0f);
+    glm::vec3 throughput(1.0f);
+    // Density the last bounce picked ray.direction with, zero for camera rays
+    // and mirror-like scattering that light sampling cannot reproduce
+    float bsdfPdf = 0.0f;
+    // Features follow delta bounces up to the first rough surface
+    bool recordFeatures = captureFeatures;
 
-    int bounces = 10;
-    for (int i = 0; i < bounces; i++)
+    for (int i = 0; i < settings.maxDepth; i++)
     {
-        if (activeScene->hit(ray, 0.001f, std::numeric_limits<float>::max(), payload))
-        {
-            glm::vec3 emission = payload.mat->emitted(ray, payload, payload.u, payload.v, payload.worldPosition);
-            if (payload.mat->scatter(ray, payload, attenuation, scattered))
-            {
-                color += (attenuation * emission);
-                ray.origin = scattered.origin;
-                ray.direction = scattered.direction;
-            }
-            else
-            {
-                color += (attenuation * emission);
-                break;
-            }
-        }
-        else
+        sampler.startBounce(i);
+        if (i > 0)
+            hit = activeScene->hit(ray, 0.001f, std::numeric_limits<float>::max(), payload);
+
+        if (!hit)
         {
-            color += (attenuation * settings.backgroundColor);
+            if (recordFeatures)
+                features.addMiss(throughput);
+            color += throughput * settings.backgroundColor;
             break;
         }
+
+        const Material *mat = activeScene->getMaterial(payload.materialId);
+        if (recordFeatures)
+            features.addHit(ray, payload, throughput * mat->albedo(payload));
+        glm::vec3 emission = mat->emitted(ray, payload, payload.u, payload.v, payload.worldPosition);
+        if (emission != glm::vec3(0.0f))
+            color += throughput * emission * (settings.nextEventEstimation ? activeScene->getEmissionWeight(ray, payload, bsdfPdf) : 1.0f);
+
+        if (settings.nextEventEstimation)
+            color += throughput * activeScene->sampleDirectLight(ray, payload, mat, sampler);
+
+        BSDFSample bsdf;
+        if (!mat->sample(payload, -glm::normalize(ray.direction), sampler, bsdf))
+            break;
+
+        bsdfPdf = bsdf.pdf;
+        recordFeatures = recordFeatures && bsdf.pdf == 0.0f;
+        throughput *= bsdf.weight;
+        if (i + 1 >= settings.rouletteDepth && !sampler.survivesRoulette(throughput))
+            break;
+        ray = {payload.worldPosition, bsdf.direction};
     }
 
-    return glm::vec4(color, 1.0f);
+    return color;
 }
 
 uint32_t Renderer::convertToABGR(const glm::vec4 &color)
@@ -191,7 +1122,24 @@ uint32_t Renderer::convertToABGR(const glm::vec4 &color)
     return (a << 24) | (b << 16) | (g << 8) | r;
 }
 
+uint32_t Renderer::getWidth() const
+{
+    return width;
+}
+
+uint32_t Renderer::getHeight() const
+{
+    return height;
+}
+
+const uint32_t *Renderer::getImageData() const
+{
+    return imageDataToTexture;
+}
+
+#ifndef RAYZ_HEADLESS
 std::shared_ptr<Image> Renderer::getFinalImage()
 {
     return finalImage;
-}
\ No newline at end of file
+}
+#endif
@@ -1,9 +1,27 @@
+#include <algorithm>
+
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#include "jug/fileDialog.h"
+#endif
 #include "scene.h"
 #include "objects.h"
 #include "materials.h"
 #include "textures.h"
 
+namespace
+{
+    // FNV-1a, 64 bit
+    void hashBytes(uint64_t &hash, const void *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= ((const uint8_t *)data)[i];
+            hash *= 1099511628211ull;
+        }
+    }
+}
+
 Scene::Scene(const std::string &name)
     : Hittable(name)
 {
@@ -18,11 +36,42 @@ Scene::Scene(const std::string &name, const std::shared_ptr<Hittable> &object)
 void Scene::clear()
 {
     objects.clear();
+    materials.clear();
+    dirty = true;
 }
 
 void Scene::add(const std::shared_ptr<Hittable> &object)
 {
     objects.push_back(object);
+    dirty = true;
+}
+
+uint32_t Scene::addMaterial(const std::shared_ptr<Material> &material)
+{
+    materials.push_back(material);
+    return materials.size() - 1;
+}
+
+uint32_t Scene::getMaterialCount() const
+{
+    return materials.size();
+}
+
+void Scene::loadDefault()
+{
+    // auto per1 = std::make_shared<NoiseTexture>(glm::vec3(1, 1, 1), 1.0f);
+    // auto noiseMat = std::make_shared<Lambertian>(per1);
+    uint32_t metal = addMaterial(std::make_shared<Metal>(glm::vec3(1.0f, 1.0f, 1.0f), 0.5));
+
+    uint32_t emissive = addMaterial(std::make_shared<DiffuseLight>(std::make_shared<NoiseTexture>(glm::vec3(1, 1, 1), 1.0f)));
+    uint32_t mirror = addMaterial(std::make_shared<Dieletric>(glm::vec3(1.0f, 1.0f, 1.0f), 2.0f));
+
+    add(std::make_shared<Plane>("P1", glm::vec3(0.0f, -0.6f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), mirror));
+
+    add(std::make_shared<Triangle>("T1", glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), emissive));
+    add(std::make_shared<Triangle>("T2", glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f), emissive));
+
+    add(std::make_shared<Sphere>("S1", glm::vec3(0.0f, 0.5f, 0.8f), 0.5f, metal));
 }
 
 const std::vector<std::shared_ptr<Hittable>> &Scene::getObjects() const
@@ -30,24 +79,275 @@ const std::vector<std::shared_ptr<Hittable>> &Scene::getObjects() const
     return objects;
 }
 
-bool Scene::hit(const Ray &ray, float tMin, float tMax, HitPayload &payload) const
+bool Scene::update()
+{
+    if (dirty)
+        build();
+    else if (!editedObjects.empty())
+        refit();
+    else
+        return false;
+
+    return true;
+}
+
+void Scene::build()
+{
+    boundedObjects.clear();
+    unboundedObjects.clear();
+    objectPrimitives.clear();
+    primitiveBounds.clear();
+    objectIndices.clear();
+
+    AABB box;
+    for (const auto &object : objects)
+    {
+        objectIndices.emplace(object.get(), (uint32_t)objectIndices.size());
+        if (object->boundingBox(box))
+        {
+            objectPrimitives.push_back(boundedObjects.size());
+            boundedObjects.push_back(object.get());
+            primitiveBounds.push_back(box);
+        }
+        else
+        {
+            objectPrimitives.push_back(noPrimitive);
+            unboundedObjects.push_back(object.get());
+        }
+    }
+
+    bvh.build(primitiveBounds);
+    buildEmitters();
+    editedObjects.clear();
+    dirty = false;
+}
+
+void Scene::refit()
+{
+    std::vector<uint32_t> changedPrimitives;
+    AABB box;
+    for (uint32_t objectIndex : editedObjects)
+    {
+        uint32_t primitive = objectPrimitives[objectIndex];
+        bool bounded = objects[objectIndex]->boundingBox(box);
+        if (bounded != (primitive != noPrimitive))
+        {
+            build();
+            return;
+        }
+
+        if (bounded)
+        {
+            primitiveBounds[primitive] = box;
+            changedPrimitives.push_back(primitive);
+        }
+    }
+    editedObjects.clear();
+
+    // Degraded past the threshold, start over
+    if (!bvh.refit(primitiveBounds, changedPrimitives))
+        build();
+    else
+        buildEmitters();
+}
+
+void Scene::markEdited(uint32_t objectIndex)
+{
+    editedObjects.push_back(objectIndex);
+
+    // Instances take their bounds from the object they share
+    const Hittable *edited = objects[objectIndex].get();
+    for (uint32_t i = 0; i < objects.size(); i++)
+    {
+        const auto *instance = dynamic_cast<const Instance *>(objects[i].get());
+        if (instance && instance->getObject().get() == edited)
+            editedObjects.push_back(i);
+    }
+}
+
+void Scene::buildEmitters()
+{
+    emitters.clear();
+    uint32_t materialId;
+    for (const auto &object : objects)
+        if (object->material(materialId) && materials[materialId]->isEmissive())
+            emitters.add(object.get(), materialId);
+}
+
+uint32_t Scene::getObjectIndex(const Hittable *object) const
+{
+    auto found = objectIndices.find(object);
+    return found != objectIndices.end() ? found->second : noObject;
+}
+
+uint64_t Scene::getHash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto &object : objects)
+    {
+        hashBytes(hash, object->name.data(), object->name.size());
+
+        AABB box;
+        if (object->boundingBox(box))
+        {
+            hashBytes(hash, &box.getMin(), sizeof(glm::vec3));
+            hashBytes(hash, &box.getMax(), sizeof(glm::vec3));
+        }
+
+        uint32_t materialId;
+        if (object->material(materialId))
+            hashBytes(hash, &materialId, sizeof(materialId));
+        uint32_t primitiveCount = object->getSampleablePrimitiveCount();
+        hashBytes(hash, &primitiveCount, sizeof(primitiveCount));
+    }
+
+    for (const auto &material : materials)
+    {
+        MaterialType type = material->getType();
+        hashBytes(hash, &type, sizeof(type));
+    }
+    return hash;
+}
+
+const EmitterList &Scene::getEmitters() const
+{
+    return emitters;
+}
+
+const BVH::BuildStats &Scene::getBuildStats() const
+{
+    return bvh.getBuildStats();
+}
+
+bool Scene::intersect(const Ray &ray, float tMin, float tMax, Intersection &intersection) const
 {
-    HitPayload tempPayload;
     bool hitAnything = false;
 
     auto closestSoFar = tMax;
 
-    for (const auto &object : objects)
+    for (const auto *object : unboundedObjects)
     {
-        if (object->hit(ray, tMin, closestSoFar, tempPayload))
+        if (object->intersect(ray, tMin, closestSoFar, intersection))
         {
             hitAnything = true;
-            closestSoFar = tempPayload.hitDistance;
-            payload = tempPayload;
+            closestSoFar = intersection.t;
         }
     }
 
-    return hitAnything;
+    bool hitBounded = bvh.traverse(ray, tMin, closestSoFar, [&](uint32_t primitive, float &tMaxRef)
+                                   {
+                                       if (!boundedObjects[primitive]->intersect(ray, tMin, tMaxRef, intersection))
+                                           return false;
+                                       tMaxRef = intersection.t;
+                                       return true; });
+
+    return hitAnything || hitBounded;
+}
+
+bool Scene::occluded(const Ray &ray, float tMin, float tMax) const
+{
+    for (const auto *object : unboundedObjects)
+        if (object->occluded(ray, tMin, tMax))
+            return true;
+
+    bool blocked = false;
+    bvh.traverse(ray, tMin, tMax, [&](uint32_t primitive, float &tMaxRef)
+                 {
+                     if (!boundedObjects[primitive]->occluded(ray, tMin, tMaxRef))
+                         return false;
+                     blocked = true;
+                     tMaxRef = -std::numeric_limits<float>::max();
+                     return true; });
+    return blocked;
+}
+
+glm::vec3 Scene::sampleDirectLight(const Ray &ray, const HitPayload &payload, const Material *material, Sampler &sampler) const
+{
+    ShadowRay shadowRay;
+    if (!sampleShadowRay(ray, payload, material, sampler, shadowRay) || occluded(shadowRay.ray, 0.001f, shadowRay.tMax))
+        return glm::vec3(0.0f);
+    return shadowRay.contribution;
+}
+
+bool Scene::sampleShadowRay(const Ray &ray, const HitPayload &payload, const Material *material, Sampler &sampler, ShadowRay &shadowRay) const
+{
+    if (emitters.empty())
+        return false;
+
+    EmitterList::Sample light;
+    emitters.sample(sampler, light);
+
+    glm::vec3 toLight = light.position - payload.worldPosition;
+    float distanceSquared = glm::dot(toLight, toLight);
+    float distance = glm::sqrt(distanceSquared);
+    glm::vec3 wi = toLight / distance;
+    float lightCosine = -glm::dot(wi, light.normal);
+    // Interpolated normals can face lights behind the actual surface
+    if (lightCosine <= 0.0f || glm::dot(wi, payload.geometricNormal) <= 0.0f)
+        return false;
+
+    glm::vec3 wo = -glm::normalize(ray.direction);
+    float bsdfPdf = material->pdf(payload, wo, wi);
+    glm::vec3 f = material->eval(payload, wo, wi);
+    if (bsdfPdf <= 0.0f || f == glm::vec3(0.0f))
+        return false;
+
+    HitPayload lightPayload;
+    lightPayload.worldPosition = light.position;
+    lightPayload.worldNormal = light.normal;
+    lightPayload.geometricNormal = light.normal;
+    lightPayload.materialId = light.materialId;
+    lightPayload.hitDistance = distance;
+    lightPayload.u = light.uv.x;
+    lightPayload.v = light.uv.y;
+    lightPayload.frontFace = true;
+    lightPayload.object = nullptr;
+    glm::vec3 emission = materials[light.materialId]->emitted({payload.worldPosition, wi}, lightPayload, light.uv.x, light.uv.y, light.position);
+
+    // Power heuristic, both densities over solid angle at the shading point
+    float lightPdf = emitters.getAreaPdf() * distanceSquared / lightCosine;
+    float weight = lightPdf * lightPdf / (lightPdf * lightPdf + bsdfPdf * bsdfPdf);
+
+    // Stop short of the light so its own surface does not shadow the ray
+    shadowRay.ray = {payload.worldPosition, wi};
+    shadowRay.tMax = distance * 0.999f;
+    shadowRay.contribution = emission * f * (weight / lightPdf);
+    return true;
+}
+
+float Scene::getEmissionWeight(const Ray &ray, const HitPayload &payload, float bsdfPdf) const
+{
+    if (bsdfPdf <= 0.0f || !emitters.contains(payload.object))
+        return 1.0f;
+
+    float directionLength = glm::length(ray.direction);
+    float distance = payload.hitDistance * directionLength;
+    // The same cosine sampleDirectLight converts its area density with
+    float lightCosine = glm::abs(glm::dot(ray.direction, payload.geometricNormal)) / directionLength;
+    float lightPdf = emitters.getAreaPdf() * distance * distance / glm::max(lightCosine, 1e-6f);
+    return bsdfPdf * bsdfPdf / (bsdfPdf * bsdfPdf + lightPdf * lightPdf);
+}
+
+void Scene::computeSurfaceInteraction(const Ray &ray, const Intersection &intersection, HitPayload &payload) const
+{
+    intersection.object->computeSurfaceInteraction(ray, intersection, payload);
+}
+
+uint64_t Scene::intersectPacket(RayPacket &packet, uint32_t firstActive, float tMin, Intersection *intersections) const
+{
+    uint64_t hitMask = 0;
+    for (const auto *object : unboundedObjects)
+        hitMask |= object->intersectPacket(packet, firstActive, tMin, intersections);
+
+    // Objects in a leaf only see the rays that entered it
+    bvh.traversePacket(packet, tMin, [&](uint32_t nodeIndex, uint32_t leafFirstActive)
+                       {
+                           const BVHNode &leaf = bvh.nodes[nodeIndex];
+                           const uint32_t first = std::max(firstActive, leafFirstActive);
+                           for (uint32_t i = 0; i < leaf.count; i++)
+                               hitMask |= boundedObjects[bvh.primitiveIndices[leaf.leftFirst + i]]->intersectPacket(packet, first, tMin, intersections); });
+
+    return hitMask;
 }
 
 bool Scene::boundingBox(AABB &outputBox) const
@@ -69,6 +369,7 @@ bool Scene::boundingBox(AABB &outputBox) const
     return true;
 }
 
+#ifndef RAYZ_HEADLESS
 bool Scene::renderUI()
 {
     bool moved = false;
@@ -89,6 +390,8 @@ bool Scene::renderUI()
             currentAdding = Scene::OBJECTS::SPHERE;
         if (ImGui::MenuItem("Plane"))
             currentAdding = Scene::OBJECTS::PLANE;
+        if (ImGui::MenuItem("Mesh (OBJ)"))
+            currentAdding = Scene::OBJECTS::MESH;
         ImGui::EndPopup();
     }
 
@@ -103,7 +406,7 @@ bool Scene::renderUI()
 
         if (ImGui::Button("OK", ImVec2(120, 0)))
         {
-            add(std::make_shared<Sphere>(sphereNameBuf));
+            add(std::make_shared<Sphere>(sphereNameBuf, addMaterial(std::make_shared<Lambertian>(glm::vec3(1.0f, 0.0f, 0.0f)))));
             moved = true;
             currentAdding = Scene::OBJECTS::NONE;
         }
@@ -119,15 +422,54 @@ bool Scene::renderUI()
 
         if (ImGui::Button("OK", ImVec2(120, 0)))
         {
-            add(std::make_shared<Plane>(planeNameBuf, glm::vec3(0.0f, -0.6f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), std::make_shared<Lambertian>(glm::vec3(1.0f, 0.0f, 0.0f))));
+            add(std::make_shared<Plane>(planeNameBuf, glm::vec3(0.0f, -0.6f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), addMaterial(std::make_shared<Lambertian>(glm::vec3(1.0f, 0.0f, 0.0f)))));
             moved = true;
             currentAdding = Scene::OBJECTS::NONE;
         }
     }
+
+    else if (currentAdding == Scene::OBJECTS::MESH)
+    {
+        ImGui::Text("Adding Mesh");
+        ImGui::Separator();
+
+        static char meshNameBuf[64] = "";
+        ImGui::InputText("Name", meshNameBuf, 64);
+
+        if (ImGui::Button("Open OBJ", ImVec2(120, 0)))
+        {
+            std::string filePath = Jug::FileDialog::openFile("Wavefront OBJ (*.obj)\0*.obj\0");
+            if (!filePath.empty())
+            {
+                auto mesh = TriangleMesh::LoadOBJ(meshNameBuf, filePath, addMaterial(std::make_shared<Lambertian>(glm::vec3(0.8f))));
+                if (mesh)
+                {
+                    add(mesh);
+                    moved = true;
+                }
+            }
+            currentAdding = Scene::OBJECTS::NONE;
+        }
+    }
     ImGui::End();
 
+    if (ImGui::TreeNode("BVH"))
+    {
+        const auto &stats = bvh.getBuildStats();
+        ImGui::Text("Build: %.3fms", stats.buildTime);
+        ImGui::Text("SAH cost: %.3f", stats.sahCost);
+        ImGui::Text("Nodes: %u (%u wide), leaves: %u, depth: %u", stats.nodeCount, stats.wideNodeCount, stats.leafCount, stats.maxDepth);
+        ImGui::Text("Refits: %u, last %.3fms", stats.refitCount, stats.refitTime);
+
+        std::vector<float> histogram(stats.leafSizeHistogram.begin(), stats.leafSizeHistogram.end());
+        if (!histogram.empty())
+            ImGui::PlotHistogram("Leaf sizes", histogram.data(), histogram.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+        ImGui::TreePop();
+    }
+
     if (treeopen)
     {
+        std::shared_ptr<Hittable> instanced;
         for (int i = 0; i < objects.size(); i++)
         {
             const auto &object = objects[i];
@@ -137,15 +479,37 @@ bool Scene::renderUI()
                 float x = ImGui::GetContentRegionAvail().x;
                 ImGui::PushItemWidth(x);
                 if (object->renderUI())
+                {
+                    markEdited(i);
                     moved = true;
+                }
+
+                uint32_t materialId;
+                if (object->material(materialId))
+                {
+                    ImGui::SeparatorText("Mat");
+                    if (materials[materialId]->renderUI())
+                        moved = true;
+                }
+
+                // Added after the loop, objects may reallocate
+                if (!dynamic_cast<const Instance *>(object.get()) && ImGui::Button("Instance"))
+                    instanced = object;
                 ImGui::PopItemWidth();
                 ImGui::PopID();
                 ImGui::TreePop();
             }
         }
         ImGui::TreePop();
+
+        if (instanced)
+        {
+            add(std::make_shared<Instance>(instanced->name + " instance", instanced, glm::vec3(1.0f, 0.0f, 0.0f)));
+            moved = true;
+        }
     }
     ImGui::End();
 
     return moved;
 }
+#endif
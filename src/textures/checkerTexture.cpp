@@ -1,4 +1,6 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "textures/solidColor.h"
 #include "textures/checker.h"
@@ -22,6 +24,7 @@ glm::vec3 CheckerTexture::value(float u, float v, const glm::vec3 &p) const
         return even->value(u, v, p);
 }
 
+#ifndef RAYZ_HEADLESS
 bool CheckerTexture::renderUI()
 {
     bool moved = false;
@@ -31,3 +34,4 @@ bool CheckerTexture::renderUI()
         moved = true;
     return moved;
 }
+#endif
@@ -1,8 +1,10 @@
 #include <iostream>
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#include "jug/fileDialog.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "stb/stb_image.h"
-#include "jug/fileDialog.h"
 #include "textures/image.h"
 
 
@@ -59,6 +61,7 @@ glm::vec3 ImageTexture::value(float u, float v, const glm::vec3 &p) const
     return glm::vec3(colorScale * pixel[0], colorScale * pixel[1], colorScale * pixel[2]);
 }
 
+#ifndef RAYZ_HEADLESS
 bool ImageTexture::renderUI()
 {
     bool moved = false;
@@ -79,4 +82,5 @@ bool ImageTexture::renderUI()
 
     return moved;
 }
+#endif
 
@@ -1,4 +1,6 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "glm/gtc/noise.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "textures/noise.h"
@@ -19,6 +21,7 @@ glm::vec3 NoiseTexture::value(float u, float v, const glm::vec3 &p) const
     return texture->value(u, v, p) * 0.5f * (1 + glm::sin(scale * p.z) + 10 * NoiseTexture::turbulence(scale * p));
 }
 
+#ifndef RAYZ_HEADLESS
 bool NoiseTexture::renderUI()
 {
     bool moved = false;
@@ -34,6 +37,7 @@ bool NoiseTexture::renderUI()
 
     return moved;
 }
+#endif
 
 float NoiseTexture::turbulence(const glm::vec3 &p, int depth)
 {
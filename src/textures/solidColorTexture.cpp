@@ -1,4 +1,6 @@
+#ifndef RAYZ_HEADLESS
 #include "imgui.h"
+#endif
 #include "glm/gtc/type_ptr.hpp"
 #include "textures/solidColor.h"
 
@@ -12,6 +14,7 @@ glm::vec3 SolidColor::value(float u, float v, const glm::vec3 &p) const
     return color;
 }
 
+#ifndef RAYZ_HEADLESS
 bool SolidColor::renderUI()
 {
     bool moved = false;
@@ -23,3 +26,4 @@ bool SolidColor::renderUI()
     }
     return moved;
 }
+#endif
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <chrono>
+#include "tileScheduler.h"
+
+TileScheduler::TileScheduler()
+{
+}
+
+TileScheduler::~TileScheduler()
+{
+    stopWorkers();
+}
+
+void TileScheduler::setWorkerCount(uint32_t count)
+{
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+
+    if (count == workerCount)
+        return;
+
+    stopWorkers();
+    startWorkers(count);
+}
+
+uint32_t TileScheduler::getWorkerCount() const
+{
+    return workerCount;
+}
+
+void TileScheduler::setTiles(uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    tileSize = std::max(1u, tileSize);
+    if (width == imageWidth && height == imageHeight && tileSize == this->tileSize)
+        return;
+
+    imageWidth = width;
+    imageHeight = height;
+    this->tileSize = tileSize;
+
+    tiles.clear();
+    for (uint32_t y = 0; y < height; y += tileSize)
+        for (uint32_t x = 0; x < width; x += tileSize)
+            tiles.push_back({x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)});
+
+    std::sort(tiles.begin(), tiles.end(), [tileSize](const Tile &a, const Tile &b)
+              { return mortonCode(a.x / tileSize, a.y / tileSize) < mortonCode(b.x / tileSize, b.y / tileSize); });
+}
+
+const std::vector<Tile> &TileScheduler::getTiles() const
+{
+    return tiles;
+}
+
+void TileScheduler::run(const std::function<void(const Tile &, uint32_t)> &job)
+{
+    std::function<void(uint32_t, uint32_t)> tileJob = [this, &job](uint32_t index, uint32_t worker)
+    {
+        auto start = std::chrono::steady_clock::now();
+        job(tiles[index], worker);
+        tiles[index].renderTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    dispatch(tiles.size(), tileJob);
+
+    stats = Stats();
+    stats.tileCount = tiles.size();
+    stats.steals = steals.load();
+    if (tiles.empty())
+        return;
+
+    stats.minTileTime = tiles[0].renderTime;
+    for (const auto &tile : tiles)
+    {
+        stats.minTileTime = std::min(stats.minTileTime, tile.renderTime);
+        stats.maxTileTime = std::max(stats.maxTileTime, tile.renderTime);
+        stats.averageTileTime += tile.renderTime;
+    }
+    stats.averageTileTime /= tiles.size();
+}
+
+void TileScheduler::parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t, uint32_t, uint32_t)> &job)
+{
+    grain = std::max(1u, grain);
+    uint32_t chunks = (count + grain - 1) / grain;
+
+    std::function<void(uint32_t, uint32_t)> chunkJob = [count, grain, &job](uint32_t chunk, uint32_t worker)
+    {
+        uint32_t begin = chunk * grain;
+        job(begin, std::min(begin + grain, count), worker);
+    };
+
+    dispatch(chunks, chunkJob);
+}
+
+TileScheduler::Stats TileScheduler::getStats() const
+{
+    return stats;
+}
+
+void TileScheduler::startWorkers(uint32_t count)
+{
+    workerCount = count;
+    stopping = false;
+
+    queues.clear();
+    for (uint32_t i = 0; i < count; i++)
+        queues.push_back(std::make_unique<WorkerQueue>());
+
+    // The calling thread works as worker 0
+    for (uint32_t i = 1; i < count; i++)
+        threads.emplace_back(&TileScheduler::workerLoop, this, i, generation);
+}
+
+void TileScheduler::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(dispatchMutex);
+        stopping = true;
+    }
+    dispatchCondition.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    threads.clear();
+    workerCount = 0;
+}
+
+void TileScheduler::workerLoop(uint32_t worker, uint64_t seenGeneration)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(dispatchMutex);
+            dispatchCondition.wait(lock, [this, seenGeneration]
+                                   { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+        }
+
+        process(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(dispatchMutex);
+            finishedWorkers++;
+        }
+        doneCondition.notify_one();
+    }
+}
+
+void TileScheduler::dispatch(uint32_t jobCount, const std::function<void(uint32_t, uint32_t)> &job)
+{
+    if (workerCount == 0)
+        setWorkerCount(0);
+
+    if (jobCount == 0)
+        return;
+
+    // Contiguous runs keep Morton neighbours on the same worker
+    for (uint32_t w = 0; w < workerCount; w++)
+    {
+        uint32_t begin = (uint64_t)jobCount * w / workerCount;
+        uint32_t end = (uint64_t)jobCount * (w + 1) / workerCount;
+
+        auto &queue = *queues[w];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.clear();
+        for (uint32_t i = begin; i < end; i++)
+            queue.jobs.push_back(i);
+    }
+
+    steals = 0;
+    currentJob = &job;
+    {
+        std::lock_guard<std::mutex> lock(dispatchMutex);
+        finishedWorkers = 0;
+        generation++;
+    }
+    dispatchCondition.notify_all();
+
+    process(0);
+
+    std::unique_lock<std::mutex> lock(dispatchMutex);
+    doneCondition.wait(lock, [this]
+                       { return finishedWorkers == workerCount - 1; });
+    currentJob = nullptr;
+}
+
+void TileScheduler::process(uint32_t worker)
+{
+    uint32_t job;
+    while (popJob(worker, job))
+        (*currentJob)(job, worker);
+}
+
+bool TileScheduler::popJob(uint32_t worker, uint32_t &job)
+{
+    {
+        auto &own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+
+    // No new jobs are queued mid-dispatch, so one empty sweep means we are done
+    for (uint32_t i = 1; i < workerCount; i++)
+    {
+        auto &victim = *queues[(worker + i) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.back();
+            victim.jobs.pop_back();
+            steals++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t TileScheduler::mortonCode(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint32_t v)
+    {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+
+    return spread(x) | (spread(y) << 1);
+}
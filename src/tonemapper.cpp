@@ -0,0 +1,108 @@
+#include <cmath>
+#include <vector>
+
+#include "tonemapper.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAYZ_TONEMAP_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // The sRGB curve is steep near black, 2^14 entries keep every step
+    // below a fifth of an 8 bit code
+    const uint32_t encodeTableSize = 1 << 14;
+
+    // Narkowicz 2015, ACES filmic curve fit
+    const float acesA = 2.51f, acesB = 0.03f, acesC = 2.43f, acesD = 0.59f, acesE = 0.14f;
+
+    const uint8_t *getEncodeTable()
+    {
+        static const std::vector<uint8_t> table = []
+        {
+            std::vector<uint8_t> values(encodeTableSize);
+            for (uint32_t i = 0; i < encodeTableSize; i++)
+            {
+                float linear = (float)i / (encodeTableSize - 1);
+                float encoded = linear <= 0.0031308f ? 12.92f * linear : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                values[i] = (uint8_t)(encoded * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // Written so NaNs end up black and infinities white, like the SSE path
+    float applyCurve(float x, bool aces)
+    {
+        x = x > 0.0f ? x : 0.0f;
+        if (aces)
+            x = (x * (acesA * x + acesB)) / (x * (acesC * x + acesD) + acesE);
+        return x < 1.0f ? x : 1.0f;
+    }
+
+    uint32_t pack(const uint8_t *table, uint32_t r, uint32_t g, uint32_t b)
+    {
+        return 0xff000000u | ((uint32_t)table[b] << 16) | ((uint32_t)table[g] << 8) | table[r];
+    }
+}
+
+void Tonemapper::resolveRow(const glm::vec3 *sums, const uint32_t *sampleCounts, uint32_t count, uint32_t *pixels) const
+{
+    const uint8_t *table = getEncodeTable();
+    const float exposureScale = std::exp2(settings.exposure);
+    const bool aces = settings.curve == Curve::ACES;
+
+    uint32_t i = 0;
+#ifdef RAYZ_TONEMAP_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 tableScale = _mm_set1_ps((float)(encodeTableSize - 1));
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 scale = _mm_set1_ps(exposureScale);
+        if (sampleCounts)
+        {
+            __m128 n = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)&sampleCounts[i]));
+            scale = _mm_div_ps(scale, _mm_max_ps(n, one));
+        }
+
+        alignas(16) int32_t indices[3][4];
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 x = _mm_mul_ps(_mm_set_ps(sums[i + 3][c], sums[i + 2][c], sums[i + 1][c], sums[i][c]), scale);
+            // max and min return their second operand for NaN lanes
+            x = _mm_max_ps(x, zero);
+            if (aces)
+            {
+                __m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(acesA)), _mm_set1_ps(acesB)));
+                __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(acesC)), _mm_set1_ps(acesD))), _mm_set1_ps(acesE));
+                x = _mm_div_ps(numerator, denominator);
+            }
+            x = _mm_min_ps(x, one);
+            _mm_store_si128((__m128i *)indices[c], _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, tableScale), half)));
+        }
+
+        for (uint32_t lane = 0; lane < 4; lane++)
+            pixels[i + lane] = pack(table, indices[0][lane], indices[1][lane], indices[2][lane]);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float scale = exposureScale;
+        if (sampleCounts)
+            scale /= glm::max((float)sampleCounts[i], 1.0f);
+
+        uint32_t index[3];
+        for (int c = 0; c < 3; c++)
+            index[c] = (uint32_t)(applyCurve(sums[i][c] * scale, aces) * (encodeTableSize - 1) + 0.5f);
+        pixels[i] = pack(table, index[0], index[1], index[2]);
+    }
+}
+
+Tonemapper::Settings &Tonemapper::getSettings()
+{
+    return settings;
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "triangleBlock.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RAYZ_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX intrinsics anywhere, GCC and Clang need them enabled per function
+#if defined(__GNUC__) || defined(__clang__)
+#define RAYZ_TARGET_SSE2 __attribute__((target("sse2")))
+#define RAYZ_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define RAYZ_TARGET_SSE2
+#define RAYZ_TARGET_AVX2
+#endif
+
+namespace
+{
+    // The mesh test these blocks replaced used this, not Triangle's 1e-6.
+    // The determinant scales with the triangle's area, and scanned or
+    // subdivided meshes have triangles small enough that 1e-6 would drop
+    // them for every ray. The lower bound only rejects rays parallel to the
+    // plane, so meshes see grazing hits a standalone Triangle misses.
+    const float determinantEpsilon = 1e-12f;
+
+    using Kernel = int (*)(const TriangleBlock &, const Ray &, float, float, float &, float &, float &);
+
+    int intersectScalar(const TriangleBlock &block, const Ray &ray, float tMin, float tMax, float &t, float &u, float &v)
+    {
+        int closest = -1;
+        for (uint32_t i = 0; i < block.count; i++)
+        {
+            glm::vec3 e1(block.e1x[i], block.e1y[i], block.e1z[i]);
+            glm::vec3 e2(block.e2x[i], block.e2y[i], block.e2z[i]);
+
+            glm::vec3 p = glm::cross(ray.direction, e2);
+            float det = glm::dot(e1, p);
+            if (std::fabs(det) <= determinantEpsilon)
+                continue;
+
+            float invDet = 1.0f / det;
+            glm::vec3 tvec = ray.origin - glm::vec3(block.v0x[i], block.v0y[i], block.v0z[i]);
+            float laneU = glm::dot(tvec, p) * invDet;
+            if (laneU < 0 || laneU > 1)
+                continue;
+
+            glm::vec3 q = glm::cross(tvec, e1);
+            float laneV = glm::dot(ray.direction, q) * invDet;
+            if (laneV < 0 || laneU + laneV > 1)
+                continue;
+
+            float laneT = glm::dot(e2, q) * invDet;
+            if (laneT < tMin || laneT > tMax)
+                continue;
+
+            tMax = laneT;
+            t = laneT;
+            u = laneU;
+            v = laneV;
+            closest = i;
+        }
+        return closest;
+    }
+
+#ifdef RAYZ_X86
+    inline int lowestBit(uint32_t bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return (int)index;
+#else
+        return __builtin_ctz(bits);
+#endif
+    }
+
+    // Two 4 wide passes
+    RAYZ_TARGET_SSE2 int intersectSSE(const TriangleBlock &block, const Ray &ray, float tMin, float tMax, float &t, float &u, float &v)
+    {
+        const __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+        const __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 epsilon = _mm_set1_ps(determinantEpsilon);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        const __m128 minT = _mm_set1_ps(tMin);
+
+        int closest = -1;
+        for (uint32_t base = 0; base < block.count; base += 4)
+        {
+            const __m128 e1x = _mm_load_ps(block.e1x + base), e1y = _mm_load_ps(block.e1y + base), e1z = _mm_load_ps(block.e1z + base);
+            const __m128 e2x = _mm_load_ps(block.e2x + base), e2y = _mm_load_ps(block.e2y + base), e2z = _mm_load_ps(block.e2z + base);
+
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 invDet = _mm_div_ps(one, det);
+
+            __m128 tx = _mm_sub_ps(ox, _mm_load_ps(block.v0x + base));
+            __m128 ty = _mm_sub_ps(oy, _mm_load_ps(block.v0y + base));
+            __m128 tz = _mm_sub_ps(oz, _mm_load_ps(block.v0z + base));
+            __m128 laneU = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+            __m128 laneV = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+            __m128 laneT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+            __m128 mask = _mm_cmpgt_ps(_mm_and_ps(det, absMask), epsilon);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(laneU, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(laneU, one));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(laneV, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(laneU, laneV), one));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(laneT, minT));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(laneT, _mm_set1_ps(tMax)));
+            if (_mm_movemask_ps(mask) == 0)
+                continue;
+
+            __m128 masked = _mm_or_ps(_mm_and_ps(mask, laneT), _mm_andnot_ps(mask, infinity));
+            __m128 nearest = _mm_min_ps(masked, _mm_shuffle_ps(masked, masked, _MM_SHUFFLE(1, 0, 3, 2)));
+            nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+            int lane = lowestBit(_mm_movemask_ps(_mm_and_ps(mask, _mm_cmpeq_ps(masked, nearest))));
+
+            alignas(16) float us[4], vs[4], ts[4];
+            _mm_store_ps(us, laneU);
+            _mm_store_ps(vs, laneV);
+            _mm_store_ps(ts, laneT);
+
+            tMax = ts[lane];
+            t = ts[lane];
+            u = us[lane];
+            v = vs[lane];
+            closest = base + lane;
+        }
+        return closest;
+    }
+
+    RAYZ_TARGET_AVX2 int intersectAVX2(const TriangleBlock &block, const Ray &ray, float tMin, float tMax, float &t, float &u, float &v)
+    {
+        const __m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+        const __m256 dx = _mm256_set1_ps(ray.direction.x), dy = _mm256_set1_ps(ray.direction.y), dz = _mm256_set1_ps(ray.direction.z);
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+        const __m256 e1x = _mm256_load_ps(block.e1x), e1y = _mm256_load_ps(block.e1y), e1z = _mm256_load_ps(block.e1z);
+        const __m256 e2x = _mm256_load_ps(block.e2x), e2y = _mm256_load_ps(block.e2y), e2z = _mm256_load_ps(block.e2z);
+
+        __m256 px = _mm256_fmsub_ps(dy, e2z, _mm256_mul_ps(dz, e2y));
+        __m256 py = _mm256_fmsub_ps(dz, e2x, _mm256_mul_ps(dx, e2z));
+        __m256 pz = _mm256_fmsub_ps(dx, e2y, _mm256_mul_ps(dy, e2x));
+        __m256 det = _mm256_fmadd_ps(e1x, px, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1z, pz)));
+        __m256 invDet = _mm256_div_ps(one, det);
+
+        __m256 tx = _mm256_sub_ps(ox, _mm256_load_ps(block.v0x));
+        __m256 ty = _mm256_sub_ps(oy, _mm256_load_ps(block.v0y));
+        __m256 tz = _mm256_sub_ps(oz, _mm256_load_ps(block.v0z));
+        __m256 laneU = _mm256_mul_ps(_mm256_fmadd_ps(tx, px, _mm256_fmadd_ps(ty, py, _mm256_mul_ps(tz, pz))), invDet);
+
+        __m256 qx = _mm256_fmsub_ps(ty, e1z, _mm256_mul_ps(tz, e1y));
+        __m256 qy = _mm256_fmsub_ps(tz, e1x, _mm256_mul_ps(tx, e1z));
+        __m256 qz = _mm256_fmsub_ps(tx, e1y, _mm256_mul_ps(ty, e1x));
+        __m256 laneV = _mm256_mul_ps(_mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz))), invDet);
+        __m256 laneT = _mm256_mul_ps(_mm256_fmadd_ps(e2x, qx, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2z, qz))), invDet);
+
+        __m256 mask = _mm256_cmp_ps(_mm256_and_ps(det, absMask), _mm256_set1_ps(determinantEpsilon), _CMP_GT_OQ);
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneU, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneU, one, _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneV, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(laneU, laneV), one, _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneT, _mm256_set1_ps(tMin), _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(laneT, _mm256_set1_ps(tMax), _CMP_LE_OQ));
+        if (_mm256_movemask_ps(mask) == 0)
+            return -1;
+
+        __m256 masked = _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), laneT, mask);
+        __m256 nearest = _mm256_min_ps(masked, _mm256_permute2f128_ps(masked, masked, 1));
+        nearest = _mm256_min_ps(nearest, _mm256_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+        nearest = _mm256_min_ps(nearest, _mm256_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+        int lane = lowestBit(_mm256_movemask_ps(_mm256_and_ps(mask, _mm256_cmp_ps(masked, nearest, _CMP_EQ_OQ))));
+
+        alignas(32) float us[8], vs[8], ts[8];
+        _mm256_store_ps(us, laneU);
+        _mm256_store_ps(vs, laneV);
+        _mm256_store_ps(ts, laneT);
+
+        t = ts[lane];
+        u = us[lane];
+        v = vs[lane];
+        return lane;
+    }
+
+    bool cpuSupportsSSE2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+
+    bool cpuSupportsAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // FMA and OS saved YMM state are needed besides the AVX2 bit
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+#endif
+
+    struct KernelChoice
+    {
+        Kernel kernel;
+        const char *name;
+    };
+
+    KernelChoice selectKernel()
+    {
+#ifdef RAYZ_X86
+        if (cpuSupportsAVX2())
+            return {intersectAVX2, "AVX2"};
+        if (cpuSupportsSSE2())
+            return {intersectSSE, "SSE"};
+#endif
+        return {intersectScalar, "Scalar"};
+    }
+
+    const KernelChoice kernelChoice = selectKernel();
+}
+
+TriangleBlock::TriangleBlock()
+    : count(0)
+{
+    for (uint32_t i = 0; i < width; i++)
+    {
+        v0x[i] = v0y[i] = v0z[i] = 0.0f;
+        e1x[i] = e1y[i] = e1z[i] = 0.0f;
+        e2x[i] = e2y[i] = e2z[i] = 0.0f;
+        triangle[i] = 0;
+    }
+}
+
+void TriangleBlock::set(uint32_t lane, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, uint32_t triangleIndex)
+{
+    glm::vec3 e1 = v1 - v0;
+    glm::vec3 e2 = v2 - v0;
+
+    v0x[lane] = v0.x, v0y[lane] = v0.y, v0z[lane] = v0.z;
+    e1x[lane] = e1.x, e1y[lane] = e1.y, e1z[lane] = e1.z;
+    e2x[lane] = e2.x, e2y[lane] = e2.y, e2z[lane] = e2.z;
+    triangle[lane] = triangleIndex;
+    count = std::max(count, lane + 1);
+}
+
+int TriangleBlock::intersect(const Ray &ray, float tMin, float tMax, float &t, float &u, float &v) const
+{
+    return kernelChoice.kernel(*this, ray, tMin, tMax, t, u, v);
+}
+
+const char *TriangleBlock::getKernelName()
+{
+    return kernelChoice.name;
+}
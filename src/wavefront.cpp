@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "wavefront.h"
+
+namespace
+{
+    // Paths handed to a worker at once by each pass, rows for ray generation
+    const uint32_t pathGrain = 1024;
+    const uint32_t rowGrain = 8;
+    // Paths each sort job counts and scatters
+    const uint32_t sortChunk = 8192;
+
+    // Queue 0 holds the misses, material types follow
+    const uint32_t missBucket = 0;
+    const uint32_t bucketCount = (uint32_t)MaterialType::COUNT + 1;
+
+    template <typename Job>
+    void forEachPath(TileScheduler &scheduler, uint32_t count, uint32_t grain, Job &&job)
+    {
+#ifdef MT
+        scheduler.parallelFor(count, grain, [&job](uint32_t begin, uint32_t end, uint32_t worker)
+                              {
+                                  for (uint32_t i = begin; i < end; i++)
+                                      job(i); });
+#else
+        for (uint32_t i = 0; i < count; i++)
+            job(i);
+#endif
+    }
+
+    float millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void WavefrontIntegrator::render(const Scene &scene, const Camera &camera, uint32_t width, uint32_t height, const uint32_t *sampleCounts, const Options &options,
+                                 TileScheduler &scheduler)
+{
+    const uint32_t pathCount = width * height;
+    resize(pathCount);
+    stats = Stats();
+
+    const glm::vec3 cameraPosition = camera.getPosition();
+    forEachPath(scheduler, height, rowGrain, [&](uint32_t y)
+                {
+                    const uint32_t rowStart = y * width;
+                    if (options.jitter)
+                    {
+                        for (uint32_t x = 0; x < width; x++)
+                        {
+                            Sampler sampler(rowStart + x, sampleCounts[rowStart + x] + 1 + options.sampleOffset);
+                            sampler.startBounce(Sampler::cameraBounce);
+                            cameraOffsets[rowStart + x] = sampler.next2D();
+                        }
+                        camera.generateRays(0, y, width, &cameraOffsets[rowStart], &directions[rowStart]);
+                    }
+                    else
+                        camera.generateRays(0, y, width, nullptr, &directions[rowStart]);
+
+                    for (uint32_t path = rowStart; path < rowStart + width; path++)
+                    {
+                        origins[path] = cameraPosition;
+                        attenuations[path] = glm::vec3(1.0f);
+                        radiance[path] = glm::vec3(0.0f);
+                        bsdfPdfs[path] = 0.0f;
+                        features[path] = {};
+                        recordingFeatures[path] = options.features;
+                    } });
+
+    activePaths.resize(pathCount);
+    for (uint32_t i = 0; i < pathCount; i++)
+        activePaths[i] = i;
+
+    for (int bounce = 0; bounce < options.maxDepth && !activePaths.empty(); bounce++)
+    {
+        stats.pathSegments += activePaths.size();
+        stats.bounces++;
+
+        auto start = std::chrono::steady_clock::now();
+        extend(scene, scheduler);
+        stats.extendTime += millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        sortByMaterial(scene, scheduler);
+        stats.sortTime += millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        shade(scene, sampleCounts, bounce, options, scheduler);
+        stats.shadeTime += millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        traceShadowRays(scene, scheduler);
+        stats.shadowTime += millisecondsSince(start);
+
+        compact();
+    }
+}
+
+const glm::vec3 *WavefrontIntegrator::getRadiance() const
+{
+    return radiance.data();
+}
+
+const PixelFeatures *WavefrontIntegrator::getFeatures() const
+{
+    return features.data();
+}
+
+const WavefrontIntegrator::Stats &WavefrontIntegrator::getStats() const
+{
+    return stats;
+}
+
+void WavefrontIntegrator::resize(size_t pathCount)
+{
+    if (origins.size() == pathCount)
+        return;
+
+    origins.resize(pathCount);
+    directions.resize(pathCount);
+    cameraOffsets.resize(pathCount);
+    attenuations.resize(pathCount);
+    radiance.resize(pathCount);
+    bsdfPdfs.resize(pathCount);
+    features.resize(pathCount);
+    recordingFeatures.resize(pathCount);
+    hits.resize(pathCount);
+    hitFlags.resize(pathCount);
+    alive.resize(pathCount);
+    shadowRays.resize(pathCount);
+    hasShadowRay.resize(pathCount);
+    shadeQueue.resize(pathCount);
+    pathBuckets.resize(pathCount);
+}
+
+void WavefrontIntegrator::extend(const Scene &scene, TileScheduler &scheduler)
+{
+    forEachPath(scheduler, activePaths.size(), pathGrain, [&](uint32_t i)
+                {
+                    uint32_t path = activePaths[i];
+                    Ray ray = {origins[path], directions[path]};
+                    hitFlags[path] = scene.hit(ray, 0.001f, std::numeric_limits<float>::max(), hits[path]); });
+}
+
+void WavefrontIntegrator::sortByMaterial(const Scene &scene, TileScheduler &scheduler)
+{
+    // Counting sort, stable so every bucket stays in pixel order. Chunks
+    // are counted and scattered in parallel, each into its own slice of
+    // every bucket.
+    const uint32_t pathCount = activePaths.size();
+    const uint32_t chunkCount = (pathCount + sortChunk - 1) / sortChunk;
+    chunkOffsets.assign((size_t)chunkCount * bucketCount, 0);
+    forEachPath(scheduler, chunkCount, 1, [&](uint32_t chunk)
+                {
+                    uint32_t *counts = &chunkOffsets[chunk * bucketCount];
+                    const uint32_t end = std::min(pathCount, (chunk + 1) * sortChunk);
+                    for (uint32_t i = chunk * sortChunk; i < end; i++)
+                    {
+                        uint32_t path = activePaths[i];
+                        uint32_t bucket = hitFlags[path] ? (uint32_t)scene.getMaterial(hits[path].materialId)->getType() + 1 : missBucket;
+                        pathBuckets[path] = bucket;
+                        counts[bucket]++;
+                    } });
+
+    bucketOffsets.assign(bucketCount + 1, 0);
+    uint32_t offset = 0;
+    for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+    {
+        bucketOffsets[bucket] = offset;
+        for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            uint32_t &slot = chunkOffsets[chunk * bucketCount + bucket];
+            uint32_t count = slot;
+            slot = offset;
+            offset += count;
+        }
+    }
+    bucketOffsets[bucketCount] = offset;
+
+    forEachPath(scheduler, chunkCount, 1, [&](uint32_t chunk)
+                {
+                    uint32_t *cursor = &chunkOffsets[chunk * bucketCount];
+                    const uint32_t end = std::min(pathCount, (chunk + 1) * sortChunk);
+                    for (uint32_t i = chunk * sortChunk; i < end; i++)
+                    {
+                        uint32_t path = activePaths[i];
+                        shadeQueue[cursor[pathBuckets[path]]++] = path;
+                    } });
+}
+
+void WavefrontIntegrator::shade(const Scene &scene, const uint32_t *sampleCounts, int bounce, const Options &options, TileScheduler &scheduler)
+{
+    for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+    {
+        const uint32_t first = bucketOffsets[bucket];
+        const uint32_t count = bucketOffsets[bucket + 1] - first;
+        if (bucket == missBucket)
+            forEachPath(scheduler, count, pathGrain, [&](uint32_t i)
+                        { shadeMiss(shadeQueue[first + i], options); });
+        else
+            forEachPath(scheduler, count, pathGrain, [&](uint32_t i)
+                        { shadeHit(scene, shadeQueue[first + i], sampleCounts, bounce, options); });
+    }
+}
+
+void WavefrontIntegrator::shadeMiss(uint32_t path, const Options &options)
+{
+    if (recordingFeatures[path])
+        features[path].addMiss(attenuations[path]);
+    radiance[path] += attenuations[path] * options.backgroundColor;
+    hasShadowRay[path] = false;
+    alive[path] = false;
+}
+
+void WavefrontIntegrator::shadeHit(const Scene &scene, uint32_t path, const uint32_t *sampleCounts, int bounce, const Options &options)
+{
+    // Same stream as the megakernel so both modes converge to the same image
+    Sampler sampler(path, sampleCounts[path] + 1 + options.sampleOffset);
+    sampler.startBounce(bounce);
+
+    const HitPayload &payload = hits[path];
+    const Material *mat = scene.getMaterial(payload.materialId);
+    Ray ray = {origins[path], directions[path]};
+    if (recordingFeatures[path])
+        features[path].addHit(ray, payload, attenuations[path] * mat->albedo(payload));
+
+    glm::vec3 emission = mat->emitted(ray, payload, payload.u, payload.v, payload.worldPosition);
+    if (emission != glm::vec3(0.0f))
+        radiance[path] += attenuations[path] * emission * (options.nextEventEstimation ? scene.getEmissionWeight(ray, payload, bsdfPdfs[path]) : 1.0f);
+
+    // Weighted by the throughput up to here, traced after the whole batch
+    hasShadowRay[path] = options.nextEventEstimation && scene.sampleShadowRay(ray, payload, mat, sampler, shadowRays[path]);
+    if (hasShadowRay[path])
+        shadowRays[path].contribution *= attenuations[path];
+
+    BSDFSample bsdf;
+    alive[path] = mat->sample(payload, -glm::normalize(ray.direction), sampler, bsdf);
+    if (!alive[path])
+        return;
+
+    bsdfPdfs[path] = bsdf.pdf;
+    recordingFeatures[path] = recordingFeatures[path] && bsdf.pdf == 0.0f;
+    attenuations[path] *= bsdf.weight;
+    if (bounce + 1 >= options.rouletteDepth && !sampler.survivesRoulette(attenuations[path]))
+    {
+        alive[path] = false;
+        return;
+    }
+
+    origins[path] = payload.worldPosition;
+    directions[path] = bsdf.direction;
+}
+
+void WavefrontIntegrator::traceShadowRays(const Scene &scene, TileScheduler &scheduler)
+{
+    // Pixel order keeps neighbouring shadow rays together
+    shadowQueue.clear();
+    for (uint32_t path : activePaths)
+        if (hasShadowRay[path])
+            shadowQueue.push_back(path);
+    stats.shadowRays += shadowQueue.size();
+
+    forEachPath(scheduler, shadowQueue.size(), pathGrain, [&](uint32_t i)
+                {
+                    uint32_t path = shadowQueue[i];
+                    const ShadowRay &shadowRay = shadowRays[path];
+                    if (!scene.occluded(shadowRay.ray, 0.001f, shadowRay.tMax))
+                        radiance[path] += shadowRay.contribution; });
+}
+
+void WavefrontIntegrator::compact()
+{
+    uint32_t liveCount = 0;
+    for (uint32_t path : activePaths)
+        if (alive[path])
+            activePaths[liveCount++] = path;
+    activePaths.resize(liveCount);
+}
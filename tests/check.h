@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdio>
+
+// Prints the failed condition and makes the enclosing bool test function
+// return false
+#define CHECK(condition)                                                                   \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(condition))                                                                  \
+        {                                                                                  \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            return false;                                                                  \
+        }                                                                                  \
+    } while (false)
@@ -0,0 +1,214 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "imageWriter.h"
+#include "check.h"
+
+namespace
+{
+    // Odd sizes, a constant row for long RLE runs and noisy ones that are
+    // stored raw
+    const uint32_t imageWidth = 37, imageHeight = 6;
+
+    std::vector<float> makeImage(uint32_t channels)
+    {
+        std::vector<float> pixels(imageWidth * imageHeight * channels);
+        uint32_t state = 12345;
+        for (uint32_t y = 0; y < imageHeight; y++)
+        {
+            for (uint32_t i = 0; i < imageWidth * channels; i++)
+            {
+                state = state * 1664525u + 1013904223u;
+                float noise = (float)(state >> 8) * 0x1p-24f;
+                pixels[y * imageWidth * channels + i] = y == 2 ? 0.25f : (y == 3 ? i * 0.5f : noise * 100.0f - 20.0f);
+            }
+        }
+        return pixels;
+    }
+
+    ImageWriter::FloatRowSource rowsOf(const std::vector<float> &pixels, uint32_t channels)
+    {
+        return [&pixels, channels](uint32_t y, float *row)
+        {
+            std::memcpy(row, &pixels[y * imageWidth * channels], imageWidth * channels * sizeof(float));
+        };
+    }
+
+    std::vector<uint8_t> readFile(const std::string &filePath)
+    {
+        std::vector<uint8_t> bytes;
+        FILE *file = std::fopen(filePath.c_str(), "rb");
+        if (!file)
+            return bytes;
+        int c;
+        while ((c = std::fgetc(file)) != EOF)
+            bytes.push_back((uint8_t)c);
+        std::fclose(file);
+        return bytes;
+    }
+
+    uint32_t getBytes(const std::vector<uint8_t> &bytes, size_t offset, int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++)
+            value |= (uint32_t)bytes[offset + i] << (8 * i);
+        return value;
+    }
+
+    // Rows bottom-up like the writer's source, false if the header is not
+    // the expected one
+    bool readPFM(const std::string &filePath, uint32_t channels, std::vector<float> &pixels)
+    {
+        FILE *file = std::fopen(filePath.c_str(), "rb");
+        if (!file)
+            return false;
+        char kind[3] = {};
+        uint32_t width = 0, height = 0;
+        float scale = 0.0f;
+        bool valid = std::fscanf(file, "%2s %u %u %f", kind, &width, &height, &scale) == 4 && std::fgetc(file) == '\n' &&
+                     std::string(kind) == (channels == 3 ? "PF" : "Pf") && width == imageWidth && height == imageHeight && scale < 0.0f;
+        pixels.resize(imageWidth * imageHeight * channels);
+        valid = valid && std::fread(pixels.data(), sizeof(float), pixels.size(), file) == pixels.size() && std::fgetc(file) == EOF;
+        std::fclose(file);
+        return valid;
+    }
+
+    // Undoes compressRLE: the run codes, the delta coding and the byte split
+    bool decompressRLE(const uint8_t *data, size_t size, size_t expectedSize, std::vector<uint8_t> &line)
+    {
+        std::vector<uint8_t> split;
+        size_t i = 0;
+        while (i < size)
+        {
+            int8_t code = (int8_t)data[i++];
+            if (code < 0)
+            {
+                if (i + -code > size)
+                    return false;
+                split.insert(split.end(), data + i, data + i + -code);
+                i += -code;
+            }
+            else
+            {
+                if (i >= size)
+                    return false;
+                split.insert(split.end(), code + 1, data[i++]);
+            }
+        }
+        if (split.size() != expectedSize)
+            return false;
+
+        for (size_t k = 1; k < split.size(); k++)
+            split[k] = (uint8_t)(split[k - 1] + split[k] - 128);
+        line.resize(expectedSize);
+        for (size_t k = 0; k < expectedSize; k++)
+            line[k] = split[(k & 1) ? (expectedSize + 1) / 2 + k / 2 : k / 2];
+        return true;
+    }
+
+    // Only what writeEXR produces: single part scanline, FLOAT channels,
+    // one line per chunk, RLE or raw lines
+    bool readEXR(const std::string &filePath, uint32_t channels, std::vector<float> &pixels)
+    {
+        std::vector<uint8_t> bytes = readFile(filePath);
+        if (bytes.size() < 8 || getBytes(bytes, 0, 4) != 20000630 || getBytes(bytes, 4, 4) != 2)
+            return false;
+
+        // Attributes until an empty name, only the channel list is checked
+        size_t offset = 8;
+        std::string channelNames;
+        while (offset < bytes.size() && bytes[offset] != 0)
+        {
+            std::string name((const char *)&bytes[offset]);
+            offset += name.size() + 1;
+            std::string type((const char *)&bytes[offset]);
+            offset += type.size() + 1;
+            uint32_t size = getBytes(bytes, offset, 4);
+            offset += 4;
+            if (name == "channels")
+                for (size_t c = offset; bytes[c] != 0; c += 18)
+                    channelNames += (char)bytes[c];
+            offset += size;
+        }
+        offset++;
+        if (channelNames != (channels == 3 ? "BGR" : "Y"))
+            return false;
+
+        const size_t lineSize = imageWidth * channels * sizeof(float);
+        pixels.resize(imageWidth * imageHeight * channels);
+        std::vector<uint8_t> line;
+        for (uint32_t lineIndex = 0; lineIndex < imageHeight; lineIndex++)
+        {
+            // Follows the offset table rather than assuming the layout
+            size_t chunk = getBytes(bytes, offset + lineIndex * 8, 4);
+            if (chunk + 8 > bytes.size() || getBytes(bytes, chunk, 4) != lineIndex)
+                return false;
+            uint32_t size = getBytes(bytes, chunk + 4, 4);
+            if (chunk + 8 + size > bytes.size())
+                return false;
+
+            const uint8_t *data = &bytes[chunk + 8];
+            if (size == lineSize)
+                line.assign(data, data + size);
+            else if (!decompressRLE(data, size, lineSize, line))
+                return false;
+
+            // Channels one after another, B G R into the interleaved R G B
+            float *row = &pixels[(imageHeight - 1 - lineIndex) * imageWidth * channels];
+            for (uint32_t c = 0; c < channels; c++)
+                for (uint32_t x = 0; x < imageWidth; x++)
+                    std::memcpy(&row[x * channels + (channels - 1 - c)], &line[(c * imageWidth + x) * sizeof(float)], sizeof(float));
+        }
+        return true;
+    }
+
+    bool testPFMRoundTrip()
+    {
+        for (uint32_t channels : {1u, 3u})
+        {
+            const std::vector<float> pixels = makeImage(channels);
+            const std::string filePath = "imageWriterTest.pfm";
+            CHECK(ImageWriter::writePFM(filePath, imageWidth, imageHeight, channels, rowsOf(pixels, channels)));
+
+            std::vector<float> read;
+            CHECK(readPFM(filePath, channels, read));
+            CHECK(read == pixels);
+            std::remove(filePath.c_str());
+        }
+        return true;
+    }
+
+    bool testEXRRoundTrip()
+    {
+        for (uint32_t channels : {1u, 3u})
+        {
+            const std::vector<float> pixels = makeImage(channels);
+            const std::string filePath = "imageWriterTest.exr";
+            CHECK(ImageWriter::writeEXR(filePath, imageWidth, imageHeight, channels, rowsOf(pixels, channels)));
+
+            std::vector<float> read;
+            CHECK(readEXR(filePath, channels, read));
+            CHECK(read == pixels);
+            std::remove(filePath.c_str());
+        }
+        return true;
+    }
+
+    bool testRejectsBadSizes()
+    {
+        const std::vector<float> pixels = makeImage(3);
+        CHECK(!ImageWriter::writePFM("imageWriterTest.pfm", 0, imageHeight, 3, rowsOf(pixels, 3)));
+        CHECK(!ImageWriter::writeEXR("imageWriterTest.exr", imageWidth, imageHeight, 2, rowsOf(pixels, 3)));
+        return true;
+    }
+}
+
+int main()
+{
+    bool passed = testPFMRoundTrip();
+    passed = testEXRRoundTrip() && passed;
+    passed = testRejectsBadSizes() && passed;
+    return passed ? 0 : 1;
+}
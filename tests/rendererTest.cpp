@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "camera.h"
+#include "renderer.h"
+#include "scene.h"
+#include "check.h"
+
+namespace
+{
+    const uint32_t imageWidth = 96, imageHeight = 64;
+
+    void setUp(Scene &scene, Camera &camera)
+    {
+        scene.loadDefault();
+        scene.build();
+        camera.onResize(imageWidth, imageHeight);
+    }
+
+    // Every frame a full resolution sample, like rayz_cli
+    void configure(Renderer &renderer, int samples)
+    {
+        auto &settings = renderer.getSettings();
+        settings.maxFrames = samples + 1;
+        settings.dynamicResolution = false;
+        settings.tileSize = 16;
+        settings.workerCount = 4;
+        renderer.onResize(imageWidth, imageHeight);
+    }
+
+    uint32_t maxSampleCount(const Renderer &renderer, uint32_t &minCount)
+    {
+        std::vector<glm::vec4> counts;
+        renderer.getAOV(AOV::SAMPLE_COUNT, counts);
+        uint32_t maxCount = 0;
+        minCount = ~0u;
+        for (const auto &count : counts)
+        {
+            maxCount = std::max(maxCount, (uint32_t)count.x);
+            minCount = std::min(minCount, (uint32_t)count.x);
+        }
+        return maxCount;
+    }
+
+    bool testAdaptiveSamplingStopsAtCap()
+    {
+        Scene scene("test");
+        Camera camera(45.0f, 0.1f, 100.0f);
+        setUp(scene, camera);
+
+        const int samples = 24;
+        Renderer renderer;
+        configure(renderer, samples);
+        renderer.getSettings().noiseThreshold = 0.05f;
+        renderer.getSettings().adaptiveMinSamples = 4;
+
+        // Converged tiles hand their share to the noisy ones, which run
+        // ahead of the frame counter
+        const int frames = samples / 2;
+        for (int i = 0; i < frames; i++)
+            renderer.render(scene, camera);
+        uint32_t minCount;
+        uint32_t maxCount = maxSampleCount(renderer, minCount);
+        CHECK(minCount >= 4);
+        CHECK(maxCount > (uint32_t)frames);
+        CHECK(maxCount <= (uint32_t)samples);
+
+        // And stop exactly at the cap, however many frames follow
+        for (int i = frames; i < 2 * samples; i++)
+            renderer.render(scene, camera);
+        maxCount = maxSampleCount(renderer, minCount);
+        CHECK(maxCount == (uint32_t)samples);
+        return true;
+    }
+
+    bool testFramesDifferWithoutAccumulation()
+    {
+        Scene scene("test");
+        Camera camera(45.0f, 0.1f, 100.0f);
+        setUp(scene, camera);
+
+        // Each frame starts from zero samples, yet must not repeat the last
+        for (bool wavefront : {false, true})
+        {
+            Renderer renderer;
+            configure(renderer, 8);
+            renderer.getSettings().accumulate = false;
+            renderer.getSettings().wavefront = wavefront;
+
+            std::vector<glm::vec4> previous, current;
+            renderer.render(scene, camera);
+            renderer.getAOV(AOV::BEAUTY, previous);
+            renderer.render(scene, camera);
+            renderer.getAOV(AOV::BEAUTY, current);
+            CHECK(std::memcmp(previous.data(), current.data(), current.size() * sizeof(glm::vec4)) != 0);
+        }
+        return true;
+    }
+
+    bool testCheckpointResumesExactly()
+    {
+        Scene scene("test");
+        Camera camera(45.0f, 0.1f, 100.0f);
+        setUp(scene, camera);
+        const char *path = "rendererTest.rzc";
+
+        // Normals and object IDs exercise the features written after the sums
+        const int samples = 12;
+        const uint32_t aovs = (1u << (int)AOV::NORMAL) | (1u << (int)AOV::OBJECT_ID);
+        Renderer reference;
+        configure(reference, samples);
+        reference.getSettings().aovs = aovs;
+        for (int i = 0; i < samples / 2; i++)
+            reference.render(scene, camera);
+        CHECK(reference.saveCheckpoint(path, scene, camera));
+        std::vector<glm::vec4> savedObjects;
+        reference.getAOV(AOV::OBJECT_ID, savedObjects);
+        for (int i = samples / 2; i < samples; i++)
+            reference.render(scene, camera);
+
+        Renderer resumed;
+        configure(resumed, samples);
+        resumed.getSettings().aovs = aovs;
+        CHECK(resumed.loadCheckpoint(path, scene, camera));
+        CHECK(resumed.getStatus().currentSample == samples / 2 + 1);
+
+        // rayz_cli saves AOVs straight away when the checkpoint already
+        // holds every sample, object IDs then resolve through the scene
+        std::vector<glm::vec4> loadedObjects;
+        resumed.getAOV(AOV::OBJECT_ID, loadedObjects);
+        CHECK(loadedObjects.size() == savedObjects.size());
+        CHECK(std::memcmp(loadedObjects.data(), savedObjects.data(), savedObjects.size() * sizeof(glm::vec4)) == 0);
+        for (int i = samples / 2; i < samples; i++)
+            resumed.render(scene, camera);
+
+        for (AOV aov : {AOV::BEAUTY, AOV::NORMAL, AOV::OBJECT_ID, AOV::SAMPLE_COUNT})
+        {
+            std::vector<glm::vec4> expected, actual;
+            reference.getAOV(aov, expected);
+            resumed.getAOV(aov, actual);
+            // Bit for bit, resuming must not change a single sample
+            CHECK(expected.size() == actual.size());
+            CHECK(std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(glm::vec4)) == 0);
+        }
+
+        // Samples made with other settings cannot be continued
+        Renderer mismatched;
+        configure(mismatched, samples);
+        mismatched.getSettings().maxDepth = 4;
+        CHECK(!mismatched.loadCheckpoint(path, scene, camera));
+
+        Renderer resized;
+        configure(resized, samples);
+        resized.onResize(imageWidth / 2, imageHeight);
+        CHECK(!resized.loadCheckpoint(path, scene, camera));
+
+        CHECK(!resumed.loadCheckpoint("missing.rzc", scene, camera));
+        std::remove(path);
+        return true;
+    }
+}
+
+int main()
+{
+    bool passed = testAdaptiveSamplingStopsAtCap();
+    passed = testFramesDifferWithoutAccumulation() && passed;
+    passed = testCheckpointResumesExactly() && passed;
+    return passed ? 0 : 1;
+}
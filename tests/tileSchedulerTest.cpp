@@ -0,0 +1,96 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "tileScheduler.h"
+#include "check.h"
+
+namespace
+{
+    // Edges that are not multiples of the tile size leave partial tiles
+    const uint32_t imageWidth = 250, imageHeight = 130, tileSize = 16;
+
+    bool testTilesCoverImage()
+    {
+        TileScheduler scheduler;
+        scheduler.setTiles(imageWidth, imageHeight, tileSize);
+
+        std::vector<uint8_t> coverage(imageWidth * imageHeight, 0);
+        for (const Tile &tile : scheduler.getTiles())
+        {
+            CHECK(tile.width > 0 && tile.height > 0);
+            CHECK(tile.x + tile.width <= imageWidth && tile.y + tile.height <= imageHeight);
+            for (uint32_t y = tile.y; y < tile.y + tile.height; y++)
+                for (uint32_t x = tile.x; x < tile.x + tile.width; x++)
+                    coverage[x + y * imageWidth]++;
+        }
+
+        for (uint8_t count : coverage)
+            CHECK(count == 1);
+        return true;
+    }
+
+    bool testRunStealsEveryTileOnce()
+    {
+        TileScheduler scheduler;
+        scheduler.setWorkerCount(4);
+        scheduler.setTiles(imageWidth, imageHeight, tileSize);
+        const auto &tiles = scheduler.getTiles();
+
+        for (int repeat = 0; repeat < 3; repeat++)
+        {
+            std::vector<std::atomic<int>> runs(tiles.size());
+            for (auto &count : runs)
+                count = 0;
+
+            // The first worker's run of tiles is slow, the others have to
+            // steal from it to finish
+            scheduler.run([&](const Tile &tile, uint32_t worker)
+                          {
+                              uint32_t index = &tile - tiles.data();
+                              runs[index]++;
+                              if (index < tiles.size() / 4)
+                                  std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+
+            for (const auto &count : runs)
+                CHECK(count == 1);
+            CHECK(scheduler.getStats().tileCount == (int)tiles.size());
+            CHECK(scheduler.getStats().steals > 0);
+        }
+        return true;
+    }
+
+    bool testParallelForCoversRange()
+    {
+        TileScheduler scheduler;
+        scheduler.setWorkerCount(4);
+
+        const uint32_t count = 10007;
+        std::vector<std::atomic<int>> visits(count);
+        for (auto &visit : visits)
+            visit = 0;
+
+        scheduler.parallelFor(count, 64, [&](uint32_t begin, uint32_t end, uint32_t worker)
+                              {
+                                  for (uint32_t i = begin; i < end; i++)
+                                      visits[i]++; });
+
+        for (const auto &visit : visits)
+            CHECK(visit == 1);
+
+        // Nothing to do must not block
+        scheduler.parallelFor(0, 64, [&](uint32_t begin, uint32_t end, uint32_t worker)
+                              { visits[0]++; });
+        CHECK(visits[0] == 1);
+        return true;
+    }
+}
+
+int main()
+{
+    bool passed = testTilesCoverImage();
+    passed = testRunStealsEveryTileOnce() && passed;
+    passed = testParallelForCoversRange() && passed;
+    return passed ? 0 : 1;
+}